@@ -1,3 +1,14 @@
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
@@ -10,12 +21,15 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <algorithm>
 #include <chrono>
@@ -23,13 +37,27 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
+#include <cstdio>
 #include <limits>
 #include <array>
 #include <optional>
 #include <set>
 #include <ctime>
 #include <unordered_map>
-
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <filesystem>
+#include <charconv>
+#include <numeric>
+#include <random>
+
+// ĬϵĴڴСģͣ --width--height--scene 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
@@ -84,7 +112,12 @@ struct SwapChainSupportDetails {
 };
 
 struct PushConstants {
-    int frameCount;
+    uint32_t frameCount;    // ֻӣƲӰۻÿص sampleCountImage 
+    int maxAccumulation;    // >0 ʱֻۻ֡ڶʱɵĽܿ쵭
+    int maxBounce;          // ·Ķ
+    int rouletteDepth;      // ǰôβ˹̶
+    float rouletteProbability;  // ̶Ĵʵ
+    uint32_t samplesPerPass;    // ÿһλ׷ٵ·ڼĴͺдһ changeImage
 };
 
 struct Vertex {
@@ -139,1196 +172,5408 @@ struct BVHNode {
     int left, right;    // 
     int n, index;       // ҶӽڵϢ
     alignas(16)glm::vec3 AA;
+    int parent;                     // ڵ㣬Ϊ -1ռ AA ֮䣬ı䲼
     alignas(16)glm::vec3 BB;        // ײ
 };
 
-struct UniformBufferObject {
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
-    alignas(16) glm::mat4 proj;
+static unsigned resolveThreadCount(unsigned requested) {
+    if (requested > 0) return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+struct TaskGroup {
+    std::atomic<int> pending{ 0 };
 };
 
-class HelloTriangleApplication {
+// ȡ̳߳أÿ߳Լ˫˶УԼӶβȡ񣬿ʱ̵߳Ķȡ
+//  spawn/wait ⲿ߳ռ 0 ŶУ wait ʱһִ
+class TaskPool {
 public:
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
+    explicit TaskPool(unsigned threadCount) {
+        unsigned count = resolveThreadCount(threadCount);
+        for (unsigned i = 0; i < count; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (unsigned i = 1; i < count; i++) {
+            threads.emplace_back([this, i]() { workerLoop(i); });
+        }
     }
 
-private:
-    clock_t t1 = 0, t2 = 0;
-
-    GLFWwindow* window;
-
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
-
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkDevice device;
-
-    VkQueue graphicsQueue;
-    VkQueue presentQueue;
-
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
-    VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
-    std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
-
-    VkRenderPass renderPass;
-    VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
-
-    VkCommandPool commandPool;
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
 
-    VkImage changeImage;
-    VkDeviceMemory changeImageMemory;
-    VkImageView changeImageView;
-    VkSampler changSampler;
+    unsigned size() const {
+        return static_cast<unsigned>(queues.size());
+    }
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    std::vector<uint32_t> triangles;
-    std::vector<BVHNode> BVHNodes;
-    VkBuffer resourceBuffer;
-    VkDeviceMemory resourceBufferMemory;
-    std::vector<void*> uniformBuffersMapped;
+    void spawn(TaskGroup& group, std::function<void()> task) {
+        group.pending++;
+        Queue& queue = *queues[currentIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back([&group, task = std::move(task)]() {
+                task();
+                group.pending--;
+            });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wakeUp.notify_one();
+    }
 
-    std::vector<Vertex> screenVertices;
-    std::vector<uint32_t> screenIndices;
-    VkBuffer screenTrianglesBuffer;
-    VkDeviceMemory screenTrianglesBufferMemory;
+    // ȴ group еɣڼæִڲҲǶ spawn/wait
+    void wait(TaskGroup& group) {
+        while (group.pending > 0) {
+            if (!runPending()) {
+                std::this_thread::yield();
+            }
+        }
+    }
 
-    VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
+    // ִһŶеûʱ falseڵ߳æ
+    bool runPending() {
+        std::function<void()> task;
+        if (!takeTask(currentIndex(), task)) return false;
+        task();
+        return true;
+    }
 
-    std::vector<VkCommandBuffer> commandBuffers;
+    //  [0, count)  grain ֿ鲢ִ fn(begin, end, chunkIndex)ֿ鷽ʽ߳޹
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, F&& fn) {
+        TaskGroup group;
+        size_t chunks = (count + grain - 1) / grain;
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            size_t begin = chunk * grain;
+            size_t end = std::min(count, begin + grain);
+            spawn(group, [&fn, begin, end, chunk]() { fn(begin, end, chunk); });
+        }
+        wait(group);
+    }
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    uint32_t currentFrame = 0;
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
 
-    bool framebufferResized = false;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
 
-    void initWindow() {
-        glfwInit();
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    size_t queued = 0;
+    bool stopping = false;
 
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    static thread_local int workerIndex;
 
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Raytracing", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    unsigned currentIndex() const {
+        return workerIndex >= 0 && workerIndex < static_cast<int>(queues.size()) ? workerIndex : 0;
     }
 
-    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebufferResized = true;
+    bool takeTask(unsigned self, std::function<void()>& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (unsigned i = 1; !task && i < queues.size(); i++) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (task) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued--;
+            return true;
+        }
+        return false;
     }
 
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createDescriptorSetLayout();
-        createGraphicsPipeline();
-        createCommandPool();
-        createChangeImgResources();
-        createFramebuffers();
-        loadModel();
-        createBVH(BVHNodes,0,triangles.size()-1,1);
-        createResourceBuffer();
-        createDescriptorPool();
-        createDescriptorSets();
-        createCommandBuffers();
-        createSyncObjects();
+    void workerLoop(unsigned index) {
+        workerIndex = static_cast<int>(index);
+        while (true) {
+            std::function<void()> task;
+            if (takeTask(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this]() { return stopping || queued > 0; });
+            if (stopping) return;
+        }
     }
+};
 
-    void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
-        }
+thread_local int TaskPool::workerIndex = -1;
 
-        vkDeviceWaitIdle(device);
+// ͼĽڵ㣺ȫɺִСmainThread Ľڵ㴴 Vulkan ڵִ߳Уཻ̳߳
+struct StartupTask {
+    const char* name;
+    std::vector<size_t> dependencies;
+    bool mainThread;
+    std::function<void()> run;
+    double start = 0.0;     // ʼĺ
+    double end = 0.0;
+};
+
+// ֻڴӳļ
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        close();
     }
 
-    void cleanupSwapChain() {
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            close();
+            return false;
         }
-
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (!view) {
+                close();
+                return false;
+            }
         }
-
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view == MAP_FAILED) {
+                view = nullptr;
+                close();
+                return false;
+            }
+        }
+#endif
+        opened = true;
+        return true;
     }
 
-    void cleanup() {
-        cleanupSwapChain();
+    void close() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view) munmap(view, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        view = nullptr;
+        length = 0;
+        opened = false;
+    }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
+    bool isOpen() const {
+        return opened;
+    }
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    const char* data() const {
+        return static_cast<const char*>(view);
+    }
 
-        vkDestroySampler(device, changSampler, nullptr);
-        vkDestroyImageView(device, changeImageView, nullptr);
-        vkDestroyImage(device, changeImage, nullptr);
-        vkFreeMemory(device, changeImageMemory, nullptr);
+    size_t size() const {
+        return length;
+    }
 
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    void* view = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
 
-        vkDestroyBuffer(device, resourceBuffer, nullptr);
-        vkFreeMemory(device, resourceBufferMemory, nullptr);
+// 豸ڴӷ䣺ÿڴͰ룬Դڿڷ䣬vkAllocateMemory ĴԴ޹
+// פԴ buddy 䣬ƫȻС룻staging ͶصʱڴڿԷ䣬ȫͷźͷʼ
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64ull << 20;
+const VkDeviceSize MEMORY_MIN_ALLOCATION = 256;
+const uint32_t MEMORY_ORDER_COUNT = 19;         // MEMORY_MIN_ALLOCATION << 18 == MEMORY_BLOCK_SIZE
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
-        }
+enum class MemoryUsage {
+    Resident,       // ͬĻͼ
+    Transient,      // 꼴ͷŵ staging Ͷػ
+};
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;          // ԴҪĴС
+    char* mapped = nullptr;         // ɼڴӳַѼ offset
+    uint32_t memoryType = 0;
+    int pool = -1;                  // -1 Ϊڴ
+    uint32_t block = 0;
+    uint32_t order = 0;             // buddy Ľףռ MEMORY_MIN_ALLOCATION << order ֽ
+};
 
-        vkDestroyDevice(device, nullptr);
+class DeviceAllocator {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice) {
+        device = logicalDevice;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        allocationLimit = properties.limits.maxMemoryAllocationCount;
+    }
 
-        if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+    // image ʾ optimal tiling ͼ뻺ڲͬĿУش bufferImageGranularity
+    Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool image, MemoryUsage usage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Allocation allocation;
+        allocation.size = requirements.size;
+        allocation.memoryType = memoryType;
+        // ĳפԴ 2 ȡ˷̫࣬
+        VkDeviceSize limit = usage == MemoryUsage::Resident ? MEMORY_BLOCK_SIZE / 2 : MEMORY_BLOCK_SIZE;
+        if (requirements.size > limit || requirements.alignment > limit) {
+            allocation.memory = allocateMemory(requirements.size, memoryType, allocation.mapped);
+            dedicatedBytes[memoryType] += requirements.size;
+            dedicatedCount[memoryType]++;
+            return allocation;
         }
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
-
-        glfwDestroyWindow(window);
-
-        glfwTerminate();
+        allocation.pool = findPool(memoryType, image, usage);
+        Pool& pool = pools[allocation.pool];
+        auto place = [&]() {
+            return usage == MemoryUsage::Resident ? allocateBuddy(pool, requirements, allocation) : allocateLinear(pool, requirements, allocation);
+        };
+        if (!place()) {
+            addBlock(pool);
+            place();
+        }
+        Block& block = pool.blocks[allocation.block];
+        block.allocations++;
+        block.used += requirements.size;
+        allocation.memory = block.memory;
+        if (block.mapped) allocation.mapped = block.mapped + allocation.offset;
+        return allocation;
     }
 
-    void recreateSwapChain() {
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0) {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
+    void free(Allocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (allocation.pool < 0) {
+            dedicatedBytes[allocation.memoryType] -= allocation.size;
+            dedicatedCount[allocation.memoryType]--;
+            releaseMemory(allocation.memory);
+            allocation = Allocation{};
+            return;
         }
 
-        vkDeviceWaitIdle(device);
-
-        cleanupSwapChain();
-        createSwapChain();
-        createImageViews();
-        createFramebuffers();
+        Pool& pool = pools[allocation.pool];
+        Block& block = pool.blocks[allocation.block];
+        block.allocations--;
+        block.used -= allocation.size;
+        if (pool.usage == MemoryUsage::Resident) {
+            // Ҳʱϲɸһ
+            VkDeviceSize offset = allocation.offset;
+            uint32_t order = allocation.order;
+            while (order + 1 < MEMORY_ORDER_COUNT) {
+                auto buddy = block.freeLists[order].find(offset ^ (MEMORY_MIN_ALLOCATION << order));
+                if (buddy == block.freeLists[order].end()) break;
+                offset = std::min(offset, *buddy);
+                block.freeLists[order].erase(buddy);
+                order++;
+            }
+            block.freeLists[order].insert(offset);
+        }
+        else if (block.allocations == 0) {
+            block.head = 0;
+        }
+        // ÿرһտ飬ͷŵԴÿζ
+        if (block.allocations == 0 && liveBlocks(pool) > 1) {
+            releaseMemory(block.memory);
+            block = Block{};
+        }
+        allocation = Allocation{};
     }
 
-    void createInstance() {
-        if (enableValidationLayers && !checkValidationLayerSupport()) {
-            throw std::runtime_error("validation layers requested, but not available!");
+    void destroy() {
+        for (Pool& pool : pools) {
+            for (Block& block : pool.blocks) {
+                if (block.memory != VK_NULL_HANDLE) releaseMemory(block.memory);
+            }
         }
+        pools.clear();
+    }
 
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Vulkan Ray Tracing";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No Engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
-
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
+    // ÿѣֽԴʵʹõֽпռƬʣ1 - ж / 
+    void printStatistics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+            VkDeviceSize reserved = 0, used = 0, freeBytes = 0, largestFree = 0;
+            uint32_t blocks = 0, dedicated = 0, allocations = 0;
+            for (const Pool& pool : pools) {
+                if (memoryProperties.memoryTypes[pool.memoryType].heapIndex != heap) continue;
+                for (const Block& block : pool.blocks) {
+                    if (block.memory == VK_NULL_HANDLE) continue;
+                    blocks++;
+                    reserved += MEMORY_BLOCK_SIZE;
+                    used += block.used;
+                    allocations += block.allocations;
+                    if (pool.usage == MemoryUsage::Transient) {
+                        freeBytes += MEMORY_BLOCK_SIZE - block.head;
+                        largestFree = std::max(largestFree, MEMORY_BLOCK_SIZE - block.head);
+                        continue;
+                    }
+                    for (uint32_t order = 0; order < MEMORY_ORDER_COUNT; order++) {
+                        if (block.freeLists[order].empty()) continue;
+                        freeBytes += (MEMORY_MIN_ALLOCATION << order) * block.freeLists[order].size();
+                        largestFree = std::max(largestFree, MEMORY_MIN_ALLOCATION << order);
+                    }
+                }
+            }
+            for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+                if (memoryProperties.memoryTypes[type].heapIndex != heap) continue;
+                dedicated += dedicatedCount[type];
+                reserved += dedicatedBytes[type];
+                used += dedicatedBytes[type];
+                allocations += dedicatedCount[type];
+            }
+            if (reserved == 0) continue;
+            bool deviceLocal = (memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+            std::cout << "memory heap " << heap << (deviceLocal ? " (device local)" : " (host)") << ": " << blocks << " blocks + " << dedicated
+                << " dedicated, " << reserved / (1024.0 * 1024.0) << " MB reserved, " << used / (1024.0 * 1024.0) << " MB used by "
+                << allocations << " allocations, free space fragmentation " << (freeBytes > 0 ? 100.0 * (1.0 - double(largestFree) / freeBytes) : 0.0)
+                << "%" << std::endl;
+        }
+        std::cout << "vkAllocateMemory: " << liveAllocations << " live of maxMemoryAllocationCount " << allocationLimit << std::endl;
+    }
 
-        auto extensions = getRequiredExtensions();
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
+private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        char* mapped = nullptr;
+        VkDeviceSize used = 0;
+        uint32_t allocations = 0;
+        VkDeviceSize head = 0;                                          // Էһλ
+        std::array<std::set<VkDeviceSize>, MEMORY_ORDER_COUNT> freeLists;  // buddy ׿жεƫ
+    };
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+    struct Pool {
+        uint32_t memoryType = 0;
+        bool image = false;
+        MemoryUsage usage = MemoryUsage::Resident;
+        std::vector<Block> blocks;  // ͷŵĿ¿λ±ڷбֲ
+    };
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+    int findPool(uint32_t memoryType, bool image, MemoryUsage usage) {
+        for (size_t i = 0; i < pools.size(); i++) {
+            if (pools[i].memoryType == memoryType && pools[i].image == image && pools[i].usage == usage) return static_cast<int>(i);
         }
-        else {
-            createInfo.enabledLayerCount = 0;
+        Pool pool;
+        pool.memoryType = memoryType;
+        pool.image = image;
+        pool.usage = usage;
+        pools.push_back(std::move(pool));
+        return static_cast<int>(pools.size() - 1);
+    }
 
-            createInfo.pNext = nullptr;
+    void addBlock(Pool& pool) {
+        Block block;
+        block.memory = allocateMemory(MEMORY_BLOCK_SIZE, pool.memoryType, block.mapped);
+        block.freeLists[MEMORY_ORDER_COUNT - 1].insert(0);
+        for (Block& slot : pool.blocks) {
+            if (slot.memory == VK_NULL_HANDLE) {
+                slot = std::move(block);
+                return;
+            }
         }
+        pool.blocks.push_back(std::move(block));
+    }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create instance!");
+    // ƫСĿжβõĲּڿǰ
+    bool allocateBuddy(Pool& pool, const VkMemoryRequirements& requirements, Allocation& allocation) {
+        uint32_t order = 0;
+        while ((MEMORY_MIN_ALLOCATION << order) < std::max(requirements.size, requirements.alignment)) order++;
+        for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+            Block& block = pool.blocks[b];
+            if (block.memory == VK_NULL_HANDLE) continue;
+            uint32_t k = order;
+            while (k < MEMORY_ORDER_COUNT && block.freeLists[k].empty()) k++;
+            if (k == MEMORY_ORDER_COUNT) continue;
+            VkDeviceSize offset = *block.freeLists[k].begin();
+            block.freeLists[k].erase(block.freeLists[k].begin());
+            while (k > order) {
+                k--;
+                block.freeLists[k].insert(offset + (MEMORY_MIN_ALLOCATION << k));
+            }
+            allocation.block = b;
+            allocation.offset = offset;
+            allocation.order = order;
+            return true;
         }
+        return false;
     }
 
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
-        createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
+    bool allocateLinear(Pool& pool, const VkMemoryRequirements& requirements, Allocation& allocation) {
+        for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+            Block& block = pool.blocks[b];
+            if (block.memory == VK_NULL_HANDLE) continue;
+            VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+            VkDeviceSize offset = (block.head + alignment - 1) / alignment * alignment;
+            if (offset + requirements.size > MEMORY_BLOCK_SIZE) continue;
+            block.head = offset + requirements.size;
+            allocation.block = b;
+            allocation.offset = offset;
+            return true;
+        }
+        return false;
     }
 
-    void setupDebugMessenger() {
-        if (!enableValidationLayers) return;
-
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
-
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
-            throw std::runtime_error("failed to set up debug messenger!");
+    uint32_t liveBlocks(const Pool& pool) const {
+        uint32_t count = 0;
+        for (const Block& block : pool.blocks) {
+            count += block.memory != VK_NULL_HANDLE ? 1 : 0;
         }
+        return count;
     }
 
-    void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create window surface!");
+    // ɼڴ鳣פӳ
+    VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, char*& mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
         }
+        mapped = nullptr;
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            void* data;
+            vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+            mapped = static_cast<char*>(data);
+        }
+        liveAllocations++;
+        return memory;
     }
 
-    void pickPhysicalDevice() {
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+    void releaseMemory(VkDeviceMemory memory) {
+        vkFreeMemory(device, memory, nullptr);
+        liveAllocations--;
+    }
 
-        if (deviceCount == 0) {
-            throw std::runtime_error("failed to find GPUs with Vulkan support!");
-        }
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    uint32_t allocationLimit = 0;
+    uint32_t liveAllocations = 0;
+    std::vector<Pool> pools;
+    std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> dedicatedBytes{};
+    std::array<uint32_t, VK_MAX_MEMORY_TYPES> dedicatedCount{};
+    std::mutex mutex;
+};
 
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+// 64 λǼܹϣڻݼУͣseed ɴ
+static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+    auto mix = [](uint64_t k) {
+        k ^= k >> 31;
+        k *= 0xbf58476d1ce4e5b9ull;
+        k ^= k >> 29;
+        k *= 0x94d049bb133111ebull;
+        return k ^ (k >> 32);
+    };
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t k;
+        memcpy(&k, p + i, 8);
+        h = (h ^ mix(k)) * 0x100000001b3ull;
+        h = (h << 27) | (h >> 37);
+    }
+    uint64_t tail = 0;
+    for (size_t j = 0; i + j < size; j++) {
+        tail |= static_cast<uint64_t>(p[i + j]) << (8 * j);
+    }
+    return mix(h ^ mix(tail));
+}
 
-        for (const auto& device : devices) {
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-                break;
+enum class OBJLoaderType {
+    Builtin,
+    TinyObj
+};
+
+const size_t OBJ_CHUNK_SIZE = 4 << 20;      // нķֿС߽뵽β
+
+// 涥 (v, vt, vn) ±꣬תɴ 0 ʼľ±꣬ȱʡΪ -1
+struct OBJIndex {
+    int v, vt, vn;
+};
+
+// ±ԪΪĿѰַϣ̽⣩ֵΪȥغĶ
+class OBJIndexMap {
+public:
+    explicit OBJIndexMap(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) capacity <<= 1;
+        slots.assign(capacity, Slot{ { -1, -1, -1 }, 0 });
+    }
+
+    // Ѵʱԭţ¼ value
+    uint32_t insert(const OBJIndex& key, uint32_t value) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.key.v < 0) {
+                slot = { key, value };
+                count++;
+                return value;
+            }
+            if (slot.key.v == key.v && slot.key.vt == key.vt && slot.key.vn == key.vn) {
+                return slot.value;
             }
         }
+    }
 
-        if (physicalDevice == VK_NULL_HANDLE) {
-            throw std::runtime_error("failed to find a suitable GPU!");
-        }
+    size_t size() const {
+        return count;
     }
 
-    void createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+private:
+    struct Slot {
+        OBJIndex key;
+        uint32_t value;
+    };
 
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+    static size_t hash(const OBJIndex& key) {
+        uint64_t h = static_cast<uint32_t>(key.v) * 0x9e3779b97f4a7c15ull;
+        h ^= ((static_cast<uint64_t>(static_cast<uint32_t>(key.vt)) << 32) | static_cast<uint32_t>(key.vn)) * 0xbf58476d1ce4e5b9ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
 
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : uniqueQueueFamilies) {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{ { -1, -1, -1 }, 0 });
+        old.swap(slots);
+        count = 0;
+        for (const Slot& slot : old) {
+            if (slot.key.v >= 0) insert(slot.key, slot.value);
         }
+    }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
-        deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
 
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+// һжķֿ飻һͳƸǰ׺ͺڶ
+struct OBJChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t positions = 0, texcoords = 0, normals = 0;
+    size_t positionBase = 0, texcoordBase = 0, normalBase = 0;  // ֮ǰۼ
+    std::vector<OBJIndex> corners{};                            // ǻ涥㣬ÿ 3 һ
+};
 
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+static const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+static const char* nextLine(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+// ʶ׹ؼֲ'v' 㡢't' ꡢ'n' ߡ'f' 棬෵ 0
+static char readOBJKeyword(const char*& p, const char* end) {
+    p = skipBlanks(p, end);
+    const char* q = p;
+    while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') q++;
+    char type = 0;
+    if (q - p == 1 && (p[0] == 'v' || p[0] == 'f')) type = p[0];
+    else if (q - p == 2 && p[0] == 'v' && (p[1] == 't' || p[1] == 'n')) type = p[1];
+    p = q;
+    return type;
+}
 
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
-        }
-        else {
-            createInfo.enabledLayerCount = 0;
-        }
+static const char* parseOBJFloat(const char* p, const char* end, float& value) {
+    p = skipBlanks(p, end);
+    if (p < end && *p == '+') p++;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec == std::errc::result_out_of_range) value = 0.0f;     // ļСֵ
+    else if (result.ec != std::errc()) throw std::runtime_error("invalid number in OBJ file");
+    return result.ptr;
+}
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
+// OBJ ± 1 ʼʾڵǰѳֵ
+static const char* parseOBJIndex(const char* p, const char* end, size_t seen, int& index) {
+    long long value = 0;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || value == 0) throw std::runtime_error("invalid face index in OBJ file");
+    long long resolved = value > 0 ? value - 1 : static_cast<long long>(seen) + value;
+    if (resolved < 0 || resolved > std::numeric_limits<int>::max()) throw std::runtime_error("face index out of range in OBJ file");
+    index = static_cast<int>(resolved);
+    return result.ptr;
+}
+
+static void countOBJChunk(OBJChunk& chunk) {
+    for (const char* p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+        switch (readOBJKeyword(p, chunk.end)) {
+        case 'v': chunk.positions++; break;
+        case 't': chunk.texcoords++; break;
+        case 'n': chunk.normals++; break;
         }
+    }
+}
 
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+// ֱд positions ȫλã水ǻ
+static void parseOBJChunk(OBJChunk& chunk, float* positions) {
+    size_t v = chunk.positionBase, vt = chunk.texcoordBase, vn = chunk.normalBase;
+    std::vector<OBJIndex> polygon;
+    for (const char* p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+        switch (readOBJKeyword(p, chunk.end)) {
+        case 'v':
+            for (int k = 0; k < 3; k++) {
+                p = parseOBJFloat(p, chunk.end, positions[3 * v + k]);
+            }
+            v++;
+            break;
+        case 't':
+            vt++;
+            break;
+        case 'n':
+            vn++;
+            break;
+        case 'f':
+            polygon.clear();
+            while (true) {
+                p = skipBlanks(p, chunk.end);
+                if (p == chunk.end || *p == '\r' || *p == '\n' || *p == '#') break;
+                OBJIndex corner = { -1, -1, -1 };
+                p = parseOBJIndex(p, chunk.end, v, corner.v);
+                if (p < chunk.end && *p == '/') {
+                    p++;
+                    if (p < chunk.end && *p != '/') p = parseOBJIndex(p, chunk.end, vt, corner.vt);
+                    if (p < chunk.end && *p == '/') p = parseOBJIndex(p + 1, chunk.end, vn, corner.vn);
+                }
+                polygon.push_back(corner);
+            }
+            if (polygon.size() < 3) throw std::runtime_error("OBJ face with fewer than 3 vertices");
+            for (size_t k = 1; k + 1 < polygon.size(); k++) {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[k]);
+                chunk.corners.push_back(polygon[k + 1]);
+            }
+            break;
+        }
     }
+}
 
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+enum class BVHBuilderType {
+    Sweep,      // ԭʼȫ SAH
+    Binned,     // Ͱ SAH
+    LBVH,       // GPUMorton  + Karras ι
+    PLOC        // GPU Morton оֲ
+};
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+static bool isGPUBuilder(BVHBuilderType type) {
+    return type == BVHBuilderType::LBVH || type == BVHBuilderType::PLOC;
+}
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+static const char* bvhBuilderName(BVHBuilderType type) {
+    switch (type) {
+    case BVHBuilderType::Sweep: return "sweep SAH";
+    case BVHBuilderType::Binned: return "binned SAH";
+    case BVHBuilderType::LBVH: return "GPU LBVH";
+    case BVHBuilderType::PLOC: return "GPU PLOC";
+    }
+    return "unknown";
+}
 
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
+const int MAX_BVH_BINS = 256;
+const size_t BVH_PARALLEL_CHUNK = 16384;    // ڵֿΧСͰ
+const int BVH_PARALLEL_SUBTREE = 4096;      // Сڸùģһڴн
+const float SAH_TRAVERSAL_COST = 1.0f;
+const float SAH_INTERSECTION_COST = 1.0f;
+
+struct BVHBuildSettings {
+    BVHBuilderType builder = BVHBuilderType::Binned;
+    int leafSize = 1;
+    std::array<int, 3> binCount = { 32, 32, 32 };   // x,y,z ԵķͰ
+    bool compare = false;                           // һַԱ
+    bool validate = false;                          // GPU ز
+    int plocRadius = 16;
+    int width = 2;                                  // 2: 4/8: ɶ۵ɶ
+};
 
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+const int MAX_BVH_WIDTH = 8;
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+// Ҷ˳ԤȡΣ i Ӧ triangles[i]ֻһ
+// 涥ǱߣεĹλͬˮ󽻲Ųڹ©
+struct TrianglePositions {
+    alignas(16) glm::vec3 p0;
+    alignas(16) glm::vec3 p1;
+    alignas(16) glm::vec3 p2;
+};
+static_assert(sizeof(TrianglePositions) == 48, "TrianglePositions must match the std430 layout in shader.frag");
 
-        if (indices.graphicsFamily != indices.presentFamily) {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
-        }
-        else {
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        }
+// CPU ˵󽻣𲽶Ӧ scene_common.glsl --test-intersection Ա
+const float TRIANGLE_T_MIN = 0.0005f;
 
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
+struct TriangleRay {
+    glm::vec3 origin;
+    int kx, ky, kz;             // kz Ϊֵ
+    glm::vec3 shear;            // Sx, Sy, Sz
+};
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create swap chain!");
-        }
+static TriangleRay setupTriangleRay(const glm::vec3& origin, const glm::vec3& direction) {
+    glm::vec3 d = glm::abs(direction);
+    TriangleRay r;
+    r.origin = origin;
+    r.kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    r.kx = r.kz == 2 ? 0 : r.kz + 1;
+    r.ky = r.kx == 2 ? 0 : r.kx + 1;
+    if (direction[r.kz] < 0.0f) std::swap(r.kx, r.ky);
+    float invZ = 1.0f / direction[r.kz];
+    r.shear = glm::vec3(direction[r.kx] * invZ, direction[r.ky] * invZ, invZ);
+    return r;
+}
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+// ˮ󽻣ֻб closest Ľһγ
+static bool intersectWatertight(const TriangleRay& r, const TrianglePositions& tri, float closest, float& t, glm::vec2& barycentric) {
+    glm::vec3 A = tri.p0 - r.origin;
+    glm::vec3 B = tri.p1 - r.origin;
+    glm::vec3 C = tri.p2 - r.origin;
+    float Ax = A[r.kx] - r.shear.x * A[r.kz];
+    float Ay = A[r.ky] - r.shear.y * A[r.kz];
+    float Bx = B[r.kx] - r.shear.x * B[r.kz];
+    float By = B[r.ky] - r.shear.y * B[r.kz];
+    float Cx = C[r.kx] - r.shear.x * C[r.kz];
+    float Cy = C[r.ky] - r.shear.y * C[r.kz];
+
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+    if ((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f)) return false;
+    float det = U + V + W;
+    if (det == 0.0f) return false;
+
+    float T = (U * A[r.kz] + V * B[r.kz] + W * C[r.kz]) * r.shear.z;
+    float absDet = std::fabs(det);
+    float signedT = det < 0.0f ? -T : T;
+    if (signedT < TRIANGLE_T_MIN * absDet || signedT >= closest * absDet) return false;
+
+    float invDet = 1.0f / det;
+    t = T * invDet;
+    barycentric = glm::vec2(V * invDet, W * invDet);
+    return true;
+}
 
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
-    }
+// ֮ǰ shader ʹõ Moller-TrumboreΪԱȵĻ׼
+static bool intersectMollerTrumbore(const glm::vec3& origin, const glm::vec3& direction, const TrianglePositions& tri, float closest, float& t, glm::vec2& barycentric) {
+    glm::vec3 e1 = tri.p1 - tri.p0;
+    glm::vec3 e2 = tri.p2 - tri.p0;
+    glm::vec3 pvec = glm::cross(direction, e2);
+    float det = glm::dot(e1, pvec);
+    if (det == 0.0f) return false;
+    float invDet = 1.0f / det;
+
+    glm::vec3 tvec = origin - tri.p0;
+    float u = glm::dot(tvec, pvec) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 qvec = glm::cross(tvec, e1);
+    float v = glm::dot(direction, qvec) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = glm::dot(e2, qvec) * invDet;
+    if (t < TRIANGLE_T_MIN || t >= closest) return false;
+    barycentric = glm::vec2(u, v);
+    return true;
+}
 
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainImages.size());
+// ɫԵţֻҵȡ
+struct TriangleShading {
+    alignas(16) glm::vec3 color;
+    float roughness;
+    uint32_t emissive;
+    uint32_t primitive;         // ԭʼα
+};
+static_assert(sizeof(TriangleShading) == 32, "TriangleShading must match the std430 layout in shader.frag");
+
+// ΰ  x  Ȩıshader һܰѡйԴ
+// ֱӴ涥㣬뽨˳޹
+struct EmissiveTriangle {
+    alignas(16) glm::vec3 p0;
+    float threshold;            // С threshold ʱѡԼѡ alias
+    glm::vec3 p1;
+    uint32_t alias;
+    glm::vec3 p2;
+    float pad0;
+    glm::vec3 emission;
+    float pad1;
+};
+static_assert(sizeof(EmissiveTriangle) == 64, "EmissiveTriangle must match the std430 layout in scene_common.glsl");
 
-        for (uint32_t i = 0; i < swapChainImages.size(); i++) {
-            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
-        }
-    }
+// ԴĿͷӵ 16 ֽڿʼ
+struct LightTableHeader {
+    uint32_t count;
+    float totalPower;           // зε  x  ֮
+    uint32_t pad[2];
+};
 
-    void createRenderPass() {
-        //changeAttachment:ÿһ֡ºͶȡȾ
-        VkAttachmentDescription changeAttachment{};
-        changeAttachment.format = VK_FORMAT_R8G8B8A8_UNORM;
-        changeAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        changeAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-        changeAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        changeAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        changeAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        changeAttachment.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
-        changeAttachment.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+//  BVHÿڵ width ӽڵ㣬ӽڵײֱӴڸڵ
+// count > 0: Ҷӣchild Ϊ㣻count == 0: ڲڵ㣬child Ϊӽڵţcount < 0: λ
+struct WideBVHChild {
+    alignas(16) glm::vec3 AA;
+    int child;
+    glm::vec3 BB;
+    int count;
+};
+static_assert(sizeof(WideBVHChild) == 32, "WideBVHChild must match the std430 layout in shader.frag");
+
+// Ƭɫǰ󽻽׶ --bvh-stats ۼӵıÿ֡һ
+struct TraversalStats {
+    uint32_t rays;
+    uint32_t nodeFetches;
+    uint32_t boxTests;
+    uint32_t triangleTests;
+    uint32_t stackTraffic;      // ջĶдλķ
+    uint32_t culledNodes;       // ջʱ޳Ľڵ
+};
 
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+const int TRAVERSAL_STATS_INTERVAL = 100;   // ÿ֡ӡһ
+// ջΪ constant_id 5  scene_common.glslջ䣻װʱɫظڵ
+const int TRAVERSAL_STACK_SIZE = 128;
 
-        VkAttachmentReference changeAttachmentRef{};
-        changeAttachmentRef.attachment = 0;
-        changeAttachmentRef.layout = VK_IMAGE_LAYOUT_GENERAL;
+struct BVHBin {
+    glm::vec3 AA, BB;
+    int count;
+};
 
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 1;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+struct BVHBinScratch {
+    std::vector<BVHBin> bins;
+    std::vector<float> rightCost;
+};
 
-        std::array<VkAttachmentReference, 2> attachmentRefs{ changeAttachmentRef,colorAttachmentRef };
+struct BinnedSplit {
+    int axis = 0;
+    int bin = 0;            // ָλ bin  bin+1 ֮
+    float origin = 0.0f;    // İΧڸϵ
+    float scale = 0.0f;     //  -> Ͱ±
+    float cost = INFINITY;
+};
 
+struct BVHRangeBounds {
+    glm::vec3 AA = glm::vec3(INFINITY);
+    glm::vec3 BB = glm::vec3(-INFINITY);
+    glm::vec3 cMin = glm::vec3(INFINITY);     // İΧ
+    glm::vec3 cMax = glm::vec3(-INFINITY);
+};
 
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 2;
-        subpass.pColorAttachments = attachmentRefs.data();
-        subpass.pDepthStencilAttachment = nullptr;
+// нʱһҪôǴнõһҪôǲֳĽڵ
+struct BVHSubtree {
+    int l = 0, r = -1;
+    BVHNode node;
+    std::vector<BVHNode> nodes;
+    std::unique_ptr<BVHSubtree> left, right;
+};
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+// һ CPU дݣtriangles ڽбţǰαԤõĺͰΧ
+// ̨ؽԼһݣĶԱ
+struct BVHBuildContext {
+    const std::vector<Vertex>& vertices;
+    std::vector<uint32_t>& triangles;
+    std::vector<glm::vec3> centroids{};
+    std::vector<glm::vec3> AA{};
+    std::vector<glm::vec3> BB{};
+};
 
-        std::array<VkAttachmentDescription, 2> attachments = { changeAttachment, colorAttachment };
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        renderPassInfo.pAttachments = attachments.data();
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+struct BVHBuildStats {
+    size_t nodeCount = 0;
+    unsigned threads = 1;
+    int depth = 0;
+    double buildMs = 0.0;
+    float sahCost = 0.0f;
+};
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
-        }
-    }
+// GPU  shaders/lbvh_common.glsl е BuildConstants һ
+struct BVHBuildConstants {
+    uint32_t count;
+    uint32_t shift;
+    uint32_t srcOffset;
+    uint32_t dstOffset;
+    uint32_t scanOffset;
+    uint32_t sumsOffset;
+    uint32_t groupCount;
+    uint32_t radius;
+    uint32_t leafCount;
+};
 
-    void createDescriptorSetLayout() {
-        VkDescriptorSetLayoutBinding vertexLayoutBinding = {
-            0, // binding
-            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            1,
-            VK_SHADER_STAGE_FRAGMENT_BIT,
-            nullptr
-        };
-        VkDescriptorSetLayoutBinding indexLayoutBinding = {
-            1, // binding
-           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-           1,
-           VK_SHADER_STAGE_FRAGMENT_BIT,
-           nullptr
-        };
-        VkDescriptorSetLayoutBinding triangleLayoutBinding = {
-           2, // binding
-           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-           1,
-           VK_SHADER_STAGE_FRAGMENT_BIT,
-           nullptr
-        };
-        VkDescriptorSetLayoutBinding BVHLayoutBinding = {
-           3, // binding
-           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-           1,
-           VK_SHADER_STAGE_FRAGMENT_BIT,
-           nullptr
-        };
+struct BVHBuildGlobals {
+    uint32_t sceneMin[3];
+    uint32_t sceneMax[3];
+    uint32_t allocated;
+    uint32_t clusterCount;
+};
 
-        VkDescriptorSetLayoutBinding samplerLayoutBinding = {
-            4,
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            1,
-            VK_SHADER_STAGE_FRAGMENT_BIT,
-            nullptr
-        };
+const uint32_t BUILD_WORKGROUP_SIZE = 256;
+const uint32_t RADIX_BITS = 4;
+const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+const uint32_t RADIX_TILE_SIZE = BUILD_WORKGROUP_SIZE * 4;
+const uint32_t SCAN_BLOCK_SIZE = BUILD_WORKGROUP_SIZE * 2;
+const uint32_t MAX_DISPATCH_GROUPS = 65535;
+
+enum GPUBVHPass {
+    GPU_BVH_SCENE_BOUNDS,
+    GPU_BVH_MORTON,
+    GPU_BVH_RADIX_HISTOGRAM,
+    GPU_BVH_RADIX_SCATTER,
+    GPU_BVH_SCAN_BLOCK,
+    GPU_BVH_SCAN_ADD,
+    GPU_BVH_LEAVES,
+    GPU_BVH_HIERARCHY,
+    GPU_BVH_REFIT,
+    GPU_BVH_PLOC_NEAREST,
+    GPU_BVH_PLOC_MERGE,
+    GPU_BVH_PLOC_COMPACT,
+    GPU_BVH_PASS_COUNT
+};
 
-        std::array<VkDescriptorSetLayoutBinding, 5> layoutBindings{ vertexLayoutBinding ,indexLayoutBinding,triangleLayoutBinding,BVHLayoutBinding ,samplerLayoutBinding};
-        VkDescriptorSetLayoutCreateInfo descLayoutInfo = {
-            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            nullptr,
-            0,
-            5,
-            layoutBindings.data()
-        };
+const std::array<const char*, GPU_BVH_PASS_COUNT> GPU_BVH_SHADERS = {
+    "shaders/lbvh_scene_bounds.spv",
+    "shaders/lbvh_morton.spv",
+    "shaders/radix_histogram.spv",
+    "shaders/radix_scatter.spv",
+    "shaders/scan_block.spv",
+    "shaders/scan_add.spv",
+    "shaders/lbvh_leaves.spv",
+    "shaders/lbvh_hierarchy.spv",
+    "shaders/lbvh_refit.spv",
+    "shaders/ploc_nearest.spv",
+    "shaders/ploc_merge.spv",
+    "shaders/ploc_compact.spv"
+};
 
-        if (vkCreateDescriptorSetLayout(device, &descLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor set layout!");
-        }
-    }
+// 󶨵 4 ζӦʱ壻0~3 Ϊ resourceBuffer еĶ㡢Ρڵ㣬
+// ʱ֮󶨵ΪԤȡλúɫ
+enum GPUBVHBuffer {
+    GPU_BVH_KEYS,
+    GPU_BVH_VALUES,
+    GPU_BVH_SCAN,
+    GPU_BVH_PARENTS,
+    GPU_BVH_FLAGS,
+    GPU_BVH_CLUSTERS,
+    GPU_BVH_NEIGHBOURS,
+    GPU_BVH_GLOBALS,
+    GPU_BVH_BUFFER_COUNT
+};
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+// GPU ڼʱԴ꼴
+struct GPUBVHBuilder {
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    std::array<VkPipeline, GPU_BVH_PASS_COUNT> pipelines{};
+    std::array<VkBuffer, GPU_BVH_BUFFER_COUNT> buffers{};
+    std::array<Allocation, GPU_BVH_BUFFER_COUNT> memories{};
+    BVHBuildGlobals* globals = nullptr;
+    uint32_t scanSumsOffset = 0;    // ǰ׺ͻпͶε
+};
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+// ϴõ staging λ壺ܴС̶ֳɲۣÿԼդ
+// CPU дһʱ GPU ͬʱһ
+const VkDeviceSize STAGING_RING_SIZE = 64ull << 20;
+const uint32_t STAGING_RING_SLOTS = 4;
+
+struct StagingSlot {
+    VkDeviceSize offset = 0;        // ڻλе
+    VkDeviceSize used = 0;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool recording = false;
+    bool pending = false;           // ύդδȴ
+};
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
+struct StagingRing {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation memory;
+    char* mapped = nullptr;
+    VkDeviceSize slotSize = 0;
+    uint32_t slotCount = 0;         // ʱ STAGING_RING_SLOTS 
+    std::array<StagingSlot, STAGING_RING_SLOTS> slots{};
+    uint32_t current = 0;
+    VkDeviceSize uploaded = 0;
+    uint32_t submits = 0;
+};
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+// resourceBuffer иε㶼 256 ֽڶ루minStorageBufferOffsetAlignment ޣ
+// 豸޹أԭ resourceBuffer 
+const VkDeviceSize RESOURCE_ALIGNMENT = 256;
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+struct ResourceCounts {
+    size_t vertices = 0;
+    size_t indices = 0;
+    size_t triangles = 0;
+    size_t BVHNodes = 0;
+    size_t wideNodes = 0;
+};
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+// 棺ļͷ֮ resourceBuffer ֽһµ
+// ޸ loadModel еĳ㷨ṹ岼ʱҪ SCENE_CACHE_VERSION
+const char SCENE_CACHE_MAGIC[8] = { 'V', 'K', 'R', 'T', 'S', 'C', 'N', '\0' };
+const uint32_t SCENE_CACHE_VERSION = 3;
+const std::string SCENE_CACHE_DIR = "cache";
+
+struct SceneCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    uint64_t key;               // ģݺͽĹϣ
+    uint64_t counts[5];         // vertices, indices, triangles, BVHNodes, wideNodes
+    uint64_t payloadSize;
+    uint64_t checksum;          // ݲָδĹϣ
+};
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+// ߻棺ļͷ֮ vkGetPipelineCacheData ԭʼ
+// Կ pipelineCacheUUID ʱݶ±
+const char PIPELINE_CACHE_MAGIC[8] = { 'V', 'K', 'R', 'T', 'P', 'S', 'O', '\0' };
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+const std::string PIPELINE_CACHE_PATH = SCENE_CACHE_DIR + "/pipelines.bin";
+
+struct PipelineCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t uuid[VK_UUID_SIZE]; // VkPhysicalDeviceProperties::pipelineCacheUUID
+    uint64_t dataSize;
+    uint64_t checksum;          // ݲֵĹϣ
+};
 
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+// resourceBuffer еһ
+struct BufferRegion {
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+struct ResourceLayout {
+    BufferRegion vertices;
+    BufferRegion indices;
+    BufferRegion triangles;
+    BufferRegion BVHNodes;
+    BufferRegion wideNodes;
+    BufferRegion trianglePositions;
+    BufferRegion triangleShading;
+    VkDeviceSize size = 0;
+};
 
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
 
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_NONE;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
+static uint32_t groupsFor(uint32_t count, uint32_t groupSize) {
+    return (count + groupSize - 1) / groupSize;
+}
 
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+// ̬Σÿ֡ɼɫ任ģ͵ΣԵ BVHNodes ײУ˱ֲ
+const uint32_t REFIT_WORKGROUP_SIZE = 256;
+const int REFIT_CHECK_INTERVAL = 30;        // ÿ֡ں̨һ SAH 
+const int DYNAMIC_ACCUMULATION_FRAMES = 8;
+const uint32_t MAX_SAMPLES_PER_PASS = 64;       // һύĹޣⴥĳʱ
+
+struct RefitConstants {
+    glm::mat4 model;
+    uint32_t triangleCount;
+    uint32_t dynamicTriangleCount;
+    uint32_t leafCount;
+    uint32_t groupCount;
+};
 
-        VkPipelineDepthStencilStateCreateInfo depthStencil{};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_FALSE;
-        depthStencil.depthWriteEnable = VK_FALSE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_NEVER;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.stencilTestEnable = VK_FALSE;
+enum RefitPass {
+    REFIT_TRANSFORM,
+    REFIT_NODES,
+    REFIT_PASS_COUNT
+};
 
-        VkPipelineColorBlendAttachmentState changeAttachment{};
-        changeAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        changeAttachment.blendEnable = VK_FALSE;
+const std::array<const char*, REFIT_PASS_COUNT> REFIT_SHADERS = {
+    "shaders/refit_transform.spv",
+    "shaders/refit_nodes.spv"
+};
 
-        VkPipelineColorBlendAttachmentState colorAttachment{};
-        colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorAttachment.blendEnable = VK_FALSE;
+// refit еݶΣڵ㡢Ҷбĳֵÿ֡ʹõļ
+struct RefitLayout {
+    BufferRegion parents;
+    BufferRegion leaves;
+    BufferRegion flagInit;
+    BufferRegion flags;
+    VkDeviceSize size = 0;
+};
 
-        std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments{ changeAttachment ,colorAttachment };
+struct DynamicRefit {
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    std::array<VkPipeline, REFIT_PASS_COUNT> pipelines{};
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation memory;
+    RefitLayout layout;
+    uint32_t leafCount = 0;
+    StagingRing ring;               // ˵״ϴ֮ÿؽ
+};
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 2;
-        colorBlending.pAttachments = blendAttachments.data();
-        colorBlending.blendConstants[0] = 0.0f;
-        colorBlending.blendConstants[1] = 0.0f;
-        colorBlending.blendConstants[2] = 0.0f;
-        colorBlending.blendConstants[3] = 0.0f;
+// ̨Ľrebuilt ʱݷ̻߳Ա
+struct BVHRebuildResult {
+    float refitCost = 0.0f;
+    float rebuiltCost = 0.0f;
+    bool rebuilt = false;
+    double buildMs = 0.0;
+    std::vector<uint32_t> triangles;
+    std::vector<BVHNode> nodes;
+    std::vector<TrianglePositions> positions;
+    std::vector<TriangleShading> shading;
+};
 
-        std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
+// ṹÿ񵥶һõײδ BVHNodes УҶʵ
+enum MeshId {
+    MESH_MODEL,
+    MESH_BOX,
+    MESH_COUNT
+};
 
-        VkPushConstantRange pushConstantRange = {};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT; // ڶƬɫ
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PushConstants);
+struct Mesh {
+    uint32_t firstTriangle = 0;     // ԭʼα [firstTriangle, firstTriangle + triangleCount)
+    uint32_t triangleCount = 0;
+    int root = -1;                  // ײĸ BVHNodes е±꣬-1 ʾ
+    glm::vec3 AA = glm::vec3(0.0f); // ռİΧ
+    glm::vec3 BB = glm::vec3(0.0f);
+};
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
+struct MeshInstance {
+    uint32_t mesh = MESH_MODEL;
+    glm::mat4 placement = glm::mat4(1.0f);  // ڳеİڷ
+    glm::mat4 transform = glm::mat4(1.0f);  // ڷ * 
+};
 
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = &depthStencil;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+//  shader.frag е Instance Ӧľ󶼴棬ɫв
+struct GPUInstance {
+    glm::mat4 worldToObject;
+    glm::mat4 objectToWorld;
+    int32_t root;
+    int32_t mesh;
+    int32_t pad[2];
+};
+static_assert(sizeof(GPUInstance) == 144, "GPUInstance must match the std430 layout in shader.frag");
+
+//  scene_common.glsl  constant_id 0~6 ӦƬɫͲǰɫ
+struct TraceSpecialization {
+    int32_t width;          // BVH 
+    VkBool32 stats;         // ǷͳƱ
+    VkBool32 instancing;    // Ƿṹ
+    VkBool32 shortStack;    // ջ޳ΪԱõջ
+    VkBool32 nextEvent;     // Դ BSDF  MIS ϲֻ BSDF Դ
+    int32_t stackSize;      // TRAVERSAL_STACK_SIZE
+    int32_t tlasStackSize;  // ջʵ
+};
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
+const std::array<VkSpecializationMapEntry, 7> TRACE_SPECIALIZATION_ENTRIES = { {
+    { 0, 0, sizeof(int32_t) },
+    { 1, sizeof(int32_t), sizeof(VkBool32) },
+    { 2, sizeof(int32_t) + sizeof(VkBool32), sizeof(VkBool32) },
+    { 3, sizeof(int32_t) + 2 * sizeof(VkBool32), sizeof(VkBool32) },
+    { 4, sizeof(int32_t) + 3 * sizeof(VkBool32), sizeof(VkBool32) },
+    { 5, sizeof(int32_t) + 4 * sizeof(VkBool32), sizeof(int32_t) },
+    { 6, 2 * sizeof(int32_t) + 4 * sizeof(VkBool32), sizeof(int32_t) }
+} };
+
+// ǰ·׷٣ɡ󽻡ɫۻֳɶļɷ׶֮ͨ洢еĹ߶дݣ
+// 󽻺ɫгȼɷʱ R ȫƬɫʵл
+enum class RendererType {
+    Fragment,
+    Wavefront
+};
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+static const char* rendererName(RendererType type) {
+    switch (type) {
+    case RendererType::Fragment: return "fragment";
+    case RendererType::Wavefront: return "wavefront";
     }
+    return "unknown";
+}
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            std::array<VkImageView, 2> attachments = {
-                changeImageView,
-                swapChainImageViews[i]
-            };
+// changeImage  rgb Ϊ֮ͣa Ϊĸ㸱ֵɫӳʱż㣬ʱۻΪ 8 λͣ
+//  sampleCountImage е 32 λ޷Ϊ׼compensationImage ͵ Kahan 
+// float  24 λβۻĳȣ·жΪ 1920
+const VkFormat ACCUMULATION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+const VkFormat SAMPLE_COUNT_FORMAT = VK_FORMAT_R32_UINT;
+const uint32_t COMPENSATION_BINDING = 19;
+const uint32_t SAMPLE_COUNT_BINDING = 20;
+
+// ɫӳ䣺ۻֵعѹ [0, 1]д RGBA8  displayImage  blit ͼȡֵ tonemap.comp Ӧ
+enum class TonemapOperator {
+    Clamp,
+    Reinhard,
+    ACES
+};
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+struct TonemapConstants {
+    uint32_t width;
+    uint32_t height;
+    float exposure;
+    uint32_t tonemapOperator;
+    uint32_t encodeSRGB;        // ޴Ⱦû sRGB תɫб
+    uint32_t swapRedBlue;       // ֱӿ BGRA ͼʱ rb
+};
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
-        }
+// ʽ֧ blit ʱֱӿ displayImageֻÿͨ 8 λ 32 λʽ
+// ʽתͨ˳ sRGB ɫӳ䴦
+static bool copyPresentFormat(VkFormat format, bool& swapRedBlue, bool& encodeSRGB) {
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM: swapRedBlue = false; encodeSRGB = false; return true;
+    case VK_FORMAT_R8G8B8A8_SRGB: swapRedBlue = false; encodeSRGB = true; return true;
+    case VK_FORMAT_B8G8R8A8_UNORM: swapRedBlue = true; encodeSRGB = false; return true;
+    case VK_FORMAT_B8G8R8A8_SRGB: swapRedBlue = true; encodeSRGB = true; return true;
+    default: return false;
     }
+}
 
-    void createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics command pool!");
-        }
+const uint32_t TONEMAP_WORKGROUP_SIZE = 8;      //  tonemap.comp  8x8 ͬ
+
+// 򵥵 OpenEXRɨߡѹB G R  32 λͨͨ
+static bool writeEXR(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& rgb) {
+    std::vector<char> header;
+    auto put = [&](const void* data, size_t size) { header.insert(header.end(), (const char*)data, (const char*)data + size); };
+    auto putString = [&](const char* text) { put(text, strlen(text) + 1); };
+    auto putInt = [&](int32_t value) { put(&value, sizeof(value)); };
+    auto putFloat = [&](float value) { put(&value, sizeof(value)); };
+    auto attribute = [&](const char* name, const char* type, int32_t size) { putString(name); putString(type); putInt(size); };
+
+    putInt(20000630);       // ħ
+    putInt(2);              // 汾 2ɨ
+    attribute("channels", "chlist", 3 * 18 + 1);
+    for (const char* channel : { "B", "G", "R" }) {
+        putString(channel);
+        putInt(2);          // FLOAT
+        putInt(0);          // pLinear ͱֽ
+        putInt(1);          // xSampling
+        putInt(1);          // ySampling
     }
-
-    void createChangeImgResources() {
-        VkFormat changeImgFormat = VK_FORMAT_R8G8B8A8_UNORM;
-
-        createImage(swapChainExtent.width, swapChainExtent.height, changeImgFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT |VK_IMAGE_USAGE_STORAGE_BIT| VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, changeImage, changeImageMemory);
-        changeImageView = createImageView(changeImage, changeImgFormat, VK_IMAGE_ASPECT_COLOR_BIT);
-        transitionImageLayout(changeImage, changeImgFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-        VkPhysicalDeviceProperties properties{};
-        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
-
-        VkSamplerCreateInfo samplerInfo{};
-        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
-        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.anisotropyEnable = VK_TRUE;
-        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-        samplerInfo.unnormalizedCoordinates = VK_FALSE;
-        samplerInfo.compareEnable = VK_FALSE;
-        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        if (vkCreateSampler(device, &samplerInfo, nullptr, &changSampler) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture sampler!");
-        }
+    header.push_back(0);
+    attribute("compression", "compression", 1);
+    header.push_back(0);    // NO_COMPRESSION
+    int32_t window[4] = { 0, 0, static_cast<int32_t>(width) - 1, static_cast<int32_t>(height) - 1 };
+    attribute("dataWindow", "box2i", sizeof(window));
+    put(window, sizeof(window));
+    attribute("displayWindow", "box2i", sizeof(window));
+    put(window, sizeof(window));
+    attribute("lineOrder", "lineOrder", 1);
+    header.push_back(0);    // INCREASING_Y
+    attribute("pixelAspectRatio", "float", 4);
+    putFloat(1.0f);
+    attribute("screenWindowCenter", "v2f", 8);
+    putFloat(0.0f);
+    putFloat(0.0f);
+    attribute("screenWindowWidth", "float", 4);
+    putFloat(1.0f);
+    header.push_back(0);
+
+    // ÿɨߣyݴС֮ͨ˳ width  float
+    uint64_t lineSize = 2 * sizeof(int32_t) + 3ull * width * sizeof(float);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(header.data(), (std::streamsize)header.size());
+    uint64_t offset = header.size() + sizeof(uint64_t) * height;
+    for (uint32_t y = 0; y < height; y++, offset += lineSize) {
+        file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
     }
-
-    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
-        for (VkFormat format : candidates) {
-            VkFormatProperties props;
-            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-                return format;
-            }
-            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
-                return format;
+    std::vector<float> line(3ull * width);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                line[(2 - c) * width + x] = rgb[3 * ((size_t)y * width + x) + c];
             }
         }
-
-        throw std::runtime_error("failed to find supported format!");
+        int32_t lineHeader[2] = { static_cast<int32_t>(y), static_cast<int32_t>(line.size() * sizeof(float)) };
+        file.write(reinterpret_cast<const char*>(lineHeader), sizeof(lineHeader));
+        file.write(reinterpret_cast<const char*>(line.data()), (std::streamsize)(line.size() * sizeof(float)));
     }
+    return (bool)file;
+}
 
-    VkFormat findDepthFormat() {
-        return findSupportedFormat(
-            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-        );
-    }
+struct Tonemap {
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, 2> descriptorSets{};    // ֱ changeImage ͽ
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkImage displayImage = VK_NULL_HANDLE;
+    Allocation displayImageMemory;
+    VkImageView displayImageView = VK_NULL_HANDLE;
+    bool blitPresent = true;        // ʽ֧Ϊ blit Ŀ꣬ copyPresentFormat ֱӿ
+    bool copySwapRedBlue = false;
+    bool copyEncodeSRGB = false;
+};
 
-    bool hasStencilComponent(VkFormat format) {
-        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-    }
+const uint32_t WAVEFRONT_WORKGROUP_SIZE = 64;
+const VkDeviceSize WAVEFRONT_PATH_SIZE = 64;    // wavefront_common.glsl  PathState ĴС
+const VkDeviceSize WAVEFRONT_HIT_SIZE = 24;     // ClosestHit ĴСstd430  vec2  8 ֽڶ
+const VkDeviceSize WAVEFRONT_SHADOW_SIZE = 48;  // wavefront_common.glsl  ShadowRay ĴС
+const VkDeviceSize WAVEFRONT_PIXEL_SIZE = 20;   // wavefront_common.glsl  PixelSamples ĴС
+const uint32_t ADAPTIVE_MAX_PATHS = 16;         // ÿÿ֡· wavefront_common.glsl ͬ
+const VkDeviceSize WAVEFRONT_GBUFFER_SIZE = 32; // wavefront_common.glsl  GBufferTexel ĴС
+
+struct WavefrontConstants {
+    uint32_t frameCount;
+    int32_t maxAccumulation;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bounce;
+    uint32_t maxBounce;
+    int32_t rouletteDepth;
+    float rouletteProbability;
+    float adaptiveError;
+    int32_t adaptiveMinSamples;
+    uint32_t denoiseIteration;
+    uint32_t denoiseIterations;
+    uint32_t samplePass;        // һ֡ڵĵڼֲڵ·һ
+};
 
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
-        VkImageViewCreateInfo viewInfo{};
-        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.image = image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = format;
-        viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
+enum WavefrontPass {
+    WAVEFRONT_SCHEDULE,
+    WAVEFRONT_GENERATE,
+    WAVEFRONT_DISPATCH,
+    WAVEFRONT_EXTEND,
+    WAVEFRONT_SHADE,
+    WAVEFRONT_CONNECT,
+    WAVEFRONT_ACCUMULATE,
+    WAVEFRONT_DENOISE_PREPARE,
+    WAVEFRONT_DENOISE_ATROUS,
+    WAVEFRONT_PASS_COUNT
+};
 
-        VkImageView imageView;
-        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture image view!");
-        }
+const std::array<const char*, WAVEFRONT_PASS_COUNT> WAVEFRONT_SHADERS = {
+    "shaders/wavefront_schedule.spv",
+    "shaders/wavefront_generate.spv",
+    "shaders/wavefront_dispatch.spv",
+    "shaders/wavefront_extend.spv",
+    "shaders/wavefront_shade.spv",
+    "shaders/wavefront_connect.spv",
+    "shaders/wavefront_accumulate.spv",
+    "shaders/wavefront_denoise_prepare.spv",
+    "shaders/wavefront_denoise_atrous.spv"
+};
 
-        return imageView;
-    }
+// ǰеݶΣ·״̬гȺͼɷ߶С㡢Ӱߡÿصͳƣ
+// Լõ G-buffer ƹһ
+struct WavefrontLayout {
+    BufferRegion paths;
+    BufferRegion queueState;
+    BufferRegion queues;
+    BufferRegion hits;
+    BufferRegion shadows;
+    BufferRegion pixelSamples;
+    BufferRegion gbuffer;
+    BufferRegion denoise;
+    VkDeviceSize size = 0;
+};
 
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = tiling;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+struct Wavefront {
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;    // ÿ֡һͳƺʵ󶨸֡һ
+    std::array<VkPipeline, WAVEFRONT_PASS_COUNT> pipelines{};
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation memory;
+    WavefrontLayout layout;
+    VkExtent2D extent{};                            //  changeImage ͬ
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;       // ÿ֡ MAX_SAMPLES_PER_PASS  uint32_t֡ÿһڲ
+    Allocation readbackMemory;
+    uint32_t* activePixels = nullptr;
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> readbackPasses{};   // ֡д0 ʾûж
+    VkImage denoisedImage = VK_NULL_HANDLE;         // ľֵa Ϊ 1ʱ changeImage ɫӳ
+    Allocation denoisedImageMemory;
+    VkImageView denoisedImageView = VK_NULL_HANDLE;
+};
 
-        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create image!");
-        }
+// GPU ʱΣÿνʱдһʱһʱ֮Ϊöεʱ䣨ǰϣ֮Ϊ֡ GPU ʱ
+enum ProfileZone {
+    PROFILE_REFIT,
+    PROFILE_FRAGMENT,
+    PROFILE_WAVEFRONT,          // ֮ WAVEFRONT_PASS_COUNT Ϊǰ·ĸ׶
+    PROFILE_TONEMAP = PROFILE_WAVEFRONT + WAVEFRONT_PASS_COUNT,
+    PROFILE_BLIT,
+    PROFILE_ZONE_COUNT
+};
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, image, &memRequirements);
+const std::array<const char*, PROFILE_ZONE_COUNT> PROFILE_ZONE_NAMES = {
+    "refit", "fragment",
+    "schedule", "generate", "dispatch", "extend", "shade", "connect", "accumulate", "denoise_prepare", "denoise_atrous",
+    "tonemap", "blit"
+};
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+const uint32_t PROFILE_QUERIES_PER_FRAME = 4096;    // βʱֲʱǰ·ÿԼ 4 x maxBounce 
+const size_t PROFILE_WINDOW = 512;                  // ٷλô֡
+const double PROFILE_SUMMARY_SECONDS = 2.0;
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+//  PROFILE_WINDOW Ļλ壬ٷλ
+struct RollingStat {
+    std::vector<double> samples;
+    size_t next = 0;
 
-        vkBindImageMemory(device, image, imageMemory, 0);
+    void add(double value) {
+        if (samples.size() < PROFILE_WINDOW) samples.push_back(value);
+        else samples[next] = value;
+        next = (next + 1) % PROFILE_WINDOW;
     }
 
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    double percentile(double p) const {
+        if (samples.empty()) return 0.0;
+        std::vector<double> sorted(samples);
+        size_t k = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+};
 
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = image;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
+// һ֡ CPU  GPU ʱ䣨룩GPU  MAX_FRAMES_IN_FLIGHT ֮֡ȵͬһդʱȴ GPU
+struct FrameTiming {
+    uint64_t frame = 0;
+    double cpuFrame = 0.0;      // һ֡ʼ֮ǽʱ
+    double fenceWait = 0.0;
+    double acquire = 0.0;
+    double gpuTotal = 0.0;
+    std::array<double, PROFILE_ZONE_COUNT> gpu{};
+};
 
-        VkPipelineStageFlags sourceStage;
-        VkPipelineStageFlags destinationStage;
+struct Profiler {
+    VkQueryPool queryPool = VK_NULL_HANDLE;     // ÿ֡ PROFILE_QUERIES_PER_FRAME ʱ
+    bool gpuTimestamps = false;                 // ͼζ֧ʱ
+    double timestampPeriod = 1.0;               // ÿ
+    uint64_t timestampMask = ~0ull;
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> queryCounts{};
+    std::array<std::vector<ProfileZone>, MAX_FRAMES_IN_FLIGHT> zones;  //  i ʱ
+    std::array<FrameTiming, MAX_FRAMES_IN_FLIGHT> pending;
+    std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+    uint64_t frameIndex = 0;
+    RollingStat frameTimes, fenceWaits, acquires, gpuTimes;
+    std::array<double, PROFILE_ZONE_COUNT> intervalZones{};     // λܼڸεۼʱ
+    uint32_t intervalFrames = 0;
+    std::chrono::high_resolution_clock::time_point lastSummary = std::chrono::high_resolution_clock::now();
+    std::vector<FrameTiming> trace;             // ָ --profile-output ʱÿһ֡
+};
 
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+struct UniformBufferObject {
+    alignas(16) glm::mat4 model;
+    alignas(16) glm::mat4 view;
+    alignas(16) glm::mat4 proj;
+};
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+class HelloTriangleApplication {
+public:
+    void run() {
+        if (intersectionTest) {
+            testIntersection();
+            return;
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (headless && targetSamples == 0 && timeLimit <= 0.0f && !(adaptiveError > 0.0f && renderer == RendererType::Wavefront)) {
+            throw std::runtime_error("--headless needs --target-spp, --time-limit or --adaptive-error with the wavefront renderer");
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
-
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (!headless) {
+            initWindow();
+        }
+        initVulkan();
+        if (headless) {
+            renderHeadless();
         }
         else {
-            throw std::invalid_argument("unsupported layout transition!");
+            mainLoop();
         }
-
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            sourceStage, destinationStage,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-        );
-
-        endSingleTimeCommands(commandBuffer);
+        finishProfile();
+        cleanup();
     }
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+    void parseArgs(int argc, char** argv) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            std::string value;
+            size_t eq = arg.find('=');
+            if (eq != std::string::npos) {
+                value = arg.substr(eq + 1);
+                arg = arg.substr(0, eq);
+            }
+
+            if (arg == "--bvh") {
+                if (value == "binned") bvhSettings.builder = BVHBuilderType::Binned;
+                else if (value == "sweep") bvhSettings.builder = BVHBuilderType::Sweep;
+                else if (value == "lbvh") bvhSettings.builder = BVHBuilderType::LBVH;
+                else if (value == "ploc") bvhSettings.builder = BVHBuilderType::PLOC;
+                else throw std::runtime_error("unknown BVH builder: " + value);
+            }
+            else if (arg == "--bvh-bins") {
+                // "--bvh-bins=16"  "--bvh-bins=32,16,8"
+                int x = 0, y = 0, z = 0;
+                int count = sscanf(value.c_str(), "%d,%d,%d", &x, &y, &z);
+                if (count == 1) y = z = x;
+                else if (count != 3) throw std::runtime_error("invalid --bvh-bins value: " + value);
+                bvhSettings.binCount = { x, y, z };
+                for (int& bins : bvhSettings.binCount) {
+                    bins = std::clamp(bins, 2, MAX_BVH_BINS);
+                }
+            }
+            else if (arg == "--bvh-leaf") {
+                bvhSettings.leafSize = std::max(1, atoi(value.c_str()));
+            }
+            else if (arg == "--bvh-compare") {
+                bvhSettings.compare = true;
+            }
+            else if (arg == "--bvh-validate") {
+                bvhSettings.validate = true;
+            }
+            else if (arg == "--ploc-radius") {
+                bvhSettings.plocRadius = std::max(1, atoi(value.c_str()));
+            }
+            else if (arg == "--bvh-width") {
+                bvhSettings.width = atoi(value.c_str());
+                if (bvhSettings.width != 2 && bvhSettings.width != 4 && bvhSettings.width != 8) {
+                    throw std::runtime_error("invalid --bvh-width value: " + value);
+                }
+            }
+            else if (arg == "--bvh-stats") {
+                traversalStats = true;
+            }
+            else if (arg == "--traversal") {
+                if (value == "short-stack") shortStackTraversal = true;
+                else if (value == "full-stack") shortStackTraversal = false;
+                else throw std::runtime_error("unknown traversal: " + value);
+            }
+            else if (arg == "--no-cache") {
+                // ͹߻涼д
+                sceneCacheEnabled = false;
+                pipelineCacheEnabled = false;
+            }
+            else if (arg == "--obj-loader") {
+                if (value == "builtin") objLoader = OBJLoaderType::Builtin;
+                else if (value == "tinyobj") objLoader = OBJLoaderType::TinyObj;
+                else throw std::runtime_error("unknown OBJ loader: " + value);
+            }
+            else if (arg == "--obj-benchmark") {
+                objBenchmark = true;
+            }
+            else if (arg == "--dynamic") {
+                dynamicGeometry = true;
+            }
+            else if (arg == "--renderer") {
+                if (value == "fragment") renderer = RendererType::Fragment;
+                else if (value == "wavefront") renderer = RendererType::Wavefront;
+                else throw std::runtime_error("unknown renderer: " + value);
+            }
+            else if (arg == "--instances") {
+                instanceCount = std::max(0, atoi(value.c_str()));
+            }
+            else if (arg == "--rebuild-threshold") {
+                rebuildThreshold = std::max(1.0f, static_cast<float>(atof(value.c_str())));
+            }
+            else if (arg == "--light-sampling") {
+                if (value == "nee") nextEventEstimation = true;
+                else if (value == "bsdf") nextEventEstimation = false;
+                else throw std::runtime_error("unknown light sampling: " + value);
+            }
+            else if (arg == "--noise-frames") {
+                noiseFrames = std::max(0, atoi(value.c_str()));
+            }
+            else if (arg == "--max-bounces") {
+                maxBounce = std::max(1, atoi(value.c_str()));
+            }
+            else if (arg == "--roulette-depth") {
+                rouletteDepth = std::max(1, atoi(value.c_str()));
+            }
+            else if (arg == "--roulette-probability") {
+                rouletteProbability = std::min(1.0f, std::max(0.01f, static_cast<float>(atof(value.c_str()))));
+            }
+            else if (arg == "--adaptive-error") {
+                adaptiveError = std::max(0.0f, static_cast<float>(atof(value.c_str())));
+            }
+            else if (arg == "--adaptive-min-spp") {
+                adaptiveMinSamples = std::max(2, atoi(value.c_str()));
+            }
+            else if (arg == "--stop-when-converged") {
+                stopWhenConverged = true;
+            }
+            else if (arg == "--spp") {
+                samplesPerPass = std::min<int>(MAX_SAMPLES_PER_PASS, std::max(1, atoi(value.c_str())));
+            }
+            else if (arg == "--spp-budget-ms") {
+                sampleBudget = std::max(0.0f, static_cast<float>(atof(value.c_str())));
+            }
+            else if (arg == "--denoise") {
+                denoise = true;
+            }
+            else if (arg == "--denoise-iterations") {
+                denoiseIterations = std::min(10, std::max(1, atoi(value.c_str())));
+            }
+            else if (arg == "--tonemap") {
+                if (value == "clamp") tonemapOperator = TonemapOperator::Clamp;
+                else if (value == "reinhard") tonemapOperator = TonemapOperator::Reinhard;
+                else if (value == "aces") tonemapOperator = TonemapOperator::ACES;
+                else throw std::runtime_error("unknown tonemap operator: " + value);
+            }
+            else if (arg == "--exposure") {
+                exposure = std::max(0.0f, static_cast<float>(atof(value.c_str())));
+            }
+            else if (arg == "--reference") {
+                referencePath = value;
+            }
+            else if (arg == "--save-reference") {
+                saveReferencePath = value;
+            }
+            else if (arg == "--headless") {
+                headless = true;
+            }
+            else if (arg == "--output") {
+                outputPath = value;
+            }
+            else if (arg == "--width") {
+                renderWidth = static_cast<uint32_t>(std::max(1, atoi(value.c_str())));
+            }
+            else if (arg == "--height") {
+                renderHeight = static_cast<uint32_t>(std::max(1, atoi(value.c_str())));
+            }
+            else if (arg == "--scene") {
+                modelPath = value;
+            }
+            else if (arg == "--target-spp") {
+                targetSamples = std::max(0, atoi(value.c_str()));
+            }
+            else if (arg == "--time-limit") {
+                timeLimit = std::max(0.0f, static_cast<float>(atof(value.c_str())));
+            }
+            else if (arg == "--profile-output") {
+                profileOutputPath = value;
+            }
+            else if (arg == "--test-intersection") {
+                intersectionTest = true;
+            }
+            else if (arg == "--threads") {
+                threadCount = static_cast<unsigned>(std::max(0, atoi(value.c_str())));
+            }
+            else {
+                throw std::runtime_error("unknown argument: " + arg);
+            }
+        }
+    }
+
+private:
+
+    GLFWwindow* window;
+
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+    VkSurfaceKHR surface;
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device;
+
+    VkQueue graphicsQueue;
+    VkQueue presentQueue;
+
+    VkSwapchainKHR swapChain;
+    std::vector<VkImage> swapChainImages;
+    VkFormat swapChainImageFormat;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    VkFramebuffer changeFramebuffer;    // Ƭɫֻд changeImageͼɫӳ blit õ
+
+    VkRenderPass renderPass;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline graphicsPipeline;
+
+    VkCommandPool commandPool;
+    DeviceAllocator allocator;
+
+    VkImage changeImage;
+    Allocation changeImageMemory;
+    VkImageView changeImageView;
+    VkSampler changSampler;
+    VkExtent2D changeImageExtent;
+    VkImage compensationImage;          //  changeImage Сֻͬۻд
+    Allocation compensationImageMemory;
+    VkImageView compensationImageView;
+    VkImage sampleCountImage;
+    Allocation sampleCountImageMemory;
+    VkImageView sampleCountImageView;
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> triangles;
+    std::vector<BVHNode> BVHNodes;
+    size_t bvhNodeCount = 0;        // GPU ʱ BVHNodes Ϊգֻ¼ڵ
+    std::vector<WideBVHChild> wideBVHNodes;
+    std::vector<TrianglePositions> trianglePositions;
+    std::vector<TriangleShading> triangleShading;
+    BVHBuildSettings bvhSettings;
+    unsigned threadCount = 0;       // 0: ʹȫӲ߳
+    std::unique_ptr<TaskPool> taskPool;
+    VkBuffer resourceBuffer;
+    Allocation resourceBufferMemory;
+    VkBuffer lightBuffer;           // LightTableHeader + EmissiveTriangle[]
+    Allocation lightBufferMemory;
+    LightTableHeader lightHeader{};
+    std::vector<EmissiveTriangle> emissiveTriangles;
+    bool nextEventEstimation = true;
+    int maxBounce = 3;              // ·ĶߣıʱҪ±ɫ
+    int rouletteDepth = 2;          // ֮· throughput ˹̶ģڵ maxBounce ʱر
+    float rouletteProbability = 0.05f;  // ʵޣƴ·Ȩ
+    float adaptiveError = 0.0f;     // >0 ʱǰ·ֻ׷أʡµ·ָЩ
+    int adaptiveMinSamples = 16;    // ʱƲɿǼ
+    bool stopWhenConverged = false; // رմڣȾ
+    bool adaptiveConverged = false;
+    uint64_t adaptivePaths = 0;     // ׷ٵ·ʱƽÿص
+    int adaptiveFrames = 0;
+    int samplesPerPass = 1;         // ÿλÿصȾʱÿ֡ȴ¼ƺͳֵĿ
+    float sampleBudget = 0.0f;      // >0 ʱƵ֡ʱԤ㣬ÿ֡ʵʱ samplesPerPass
+    double sampleTime = 0.0;        // ƽÿֲĺʱ룩
+    std::array<int, MAX_FRAMES_IN_FLIGHT> frameSamples{};   // ÿ֡ύʱ samplesPerPass
+    std::chrono::high_resolution_clock::time_point lastFrameDone = std::chrono::high_resolution_clock::now();
+    bool denoise = false;           // ǰ·ۻ֮ a-trous 룬ֻӰʾ D л
+    int denoiseIterations = 5;
+    bool headless = false;          // ںͽȾ changeImage дͼƬȾ
+    std::string outputPath;         // .png ΪɫӳĽ.exr ΪԵۻֵ
+    uint32_t renderWidth = WIDTH;
+    uint32_t renderHeight = HEIGHT;
+    std::string modelPath = MODEL_PATH;
+    int targetSamples = 0;          // ޴Ⱦÿشﵽô
+    float timeLimit = 0.0f;         // ޴Ⱦʱޣ룩
+    int renderedSamples = 0;        // ύÿ
+    Profiler profiler;
+    std::string profileOutputPath;  // ˳ʱÿ֡ CPU  GPU ʱд .json  .csv
+    int noiseFrames = 0;            // ۻô֡ʱ changeImage 
+    std::string referencePath;      // Ųοͼ RMSE
+    std::string saveReferencePath;  // ѶصĽΪοͼ֡Ⱦ
+    int submittedFrames = 0;
+    ResourceLayout resourceLayout;
+    ResourceCounts sceneCounts;
+    bool sceneCacheEnabled = true;
+    bool pipelineCacheEnabled = true;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    size_t pipelineCacheLoaded = 0;     // ļĻֽ0 Ϊ
+    uint32_t pipelineCount = 0;
+    double pipelineCreateTime = 0.0;    //  vkCreate*Pipelines ĺʱ
+    MappedFile sceneCache;          // ʱӳ䣬ֱ createResourceBuffer 
+    OBJLoaderType objLoader = OBJLoaderType::Builtin;
+    bool objBenchmark = false;      // ǰԱֽʽ
+    bool intersectionTest = false;  // ֻ󽻵 CPU 
+    bool dynamicGeometry = false;
+    float rebuildThreshold = 1.5f;  //  SAH ۳ʱıں̨ؽ
+    size_t modelVertexCount = 0;    // ģͲֵĶΪ̬ Cornell box
+    size_t modelTriangleCount = 0;
+    float builtSAHCost = 0.0f;
+    glm::vec3 modelPivot = glm::vec3(0.0f);
+    glm::mat4 modelTransform = glm::mat4(1.0f);
+    DynamicRefit dynamicRefit;
+    std::future<BVHRebuildResult> rebuildJob;
+    int framesSinceCheck = 0;
+    int instanceCount = 0;          // >0: ģͷôʵṹ0: һ
+    std::vector<Mesh> meshes;
+    std::vector<MeshInstance> meshInstances;
+    std::vector<BVHNode> tlasNodes;
+    VkBuffer instanceBuffer;        // ÿ֡һʵͶ
+    Allocation instanceBufferMemory;
+    void* instanceBufferMapped;
+    VkDeviceSize instanceStride = 0;
+    BufferRegion instanceRegion;    // ÿһеƫ
+    BufferRegion tlasRegion;
+    RendererType renderer = RendererType::Fragment;
+    bool rendererSwitchRequested = false;
+    Wavefront wavefront;
+    Tonemap tonemap;
+    TonemapOperator tonemapOperator = TonemapOperator::Clamp;   // clamp ֮ǰ RGBA8 ۻʾЧͬ
+    float exposure = 1.0f;
+    bool traversalStats = false;
+    bool shortStackTraversal = true;
+    VkBuffer statsBuffer;
+    Allocation statsBufferMemory;
+    void* statsBufferMapped;
+    VkDeviceSize statsStride = 0;
+    std::array<uint64_t, 6> statsTotals{};
+    int statsFrames = 0;
+    std::chrono::high_resolution_clock::time_point statsStartTime = std::chrono::high_resolution_clock::now();
+    std::vector<void*> uniformBuffersMapped;
+
+    std::vector<Vertex> screenVertices;
+    std::vector<uint32_t> screenIndices;
+    VkBuffer screenTrianglesBuffer;
+    Allocation screenTrianglesBufferMemory;
+
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    std::vector<VkCommandBuffer> commandBuffers;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    uint32_t currentFrame = 0;
+
+    bool framebufferResized = false;
+
+    void initWindow() {
+        glfwInit();
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        window = glfwCreateWindow(renderWidth, renderHeight, "Vulkan Raytracing", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->framebufferResized = true;
+    }
+
+    static void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+            app->rendererSwitchRequested = true;
+        }
+        if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+            app->denoise = !app->denoise;
+            std::cout << "\ndenoiser: " << (app->denoise ? "on" : "off")
+                << (app->renderer == RendererType::Wavefront ? "" : " (runs with the wavefront renderer, press R to switch)") << std::endl;
+        }
+    }
+
+    void initVulkan() {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        // غͽֻ CPUʵ豸ߵĴͬʱУ߶ɺʼϴ
+        std::vector<StartupTask> tasks = {
+            { "scene", {}, false, [this]() {
+                createScreenQuad();
+                loadScene();
+            } },
+            { "device", {}, true, [this]() {
+                createInstance();
+                setupDebugMessenger();
+                if (!headless) {
+                    createSurface();
+                }
+                pickPhysicalDevice();
+                createLogicalDevice();
+                allocator.init(physicalDevice, device);
+                createPipelineCache();
+            } },
+            { "swapchain", { 1 }, true, [this]() {
+                if (!headless) {
+                    createSwapChain();
+                    createImageViews();
+                }
+            } },
+            { "pipeline", { 1 }, true, [this]() {
+                createRenderPass();
+                createDescriptorSetLayout();
+                createGraphicsPipeline();
+            } },
+            { "targets", { 2, 3 }, true, [this]() {
+                createCommandPool();
+                createChangeImgResources();
+                createChangeFramebuffer();
+            } },
+            { "upload", { 0, 4 }, true, [this]() {
+                createResourceBuffer();
+                if (isGPUBuilder(bvhSettings.builder)) {
+                    buildBVHOnGPU();
+                }
+                if (dynamicGeometry && instanceCount == 0) {
+                    createDynamicRefit();
+                }
+                createInstanceBuffer();
+                createTraversalStatsBuffer();
+            } },
+            { "compute", { 5 }, true, [this]() {
+                createDescriptorPool();
+                createDescriptorSets();
+                createWavefront();
+                createTonemap();
+                createCommandBuffers();
+                createSyncObjects();
+                createProfiler();
+            } },
+        };
+        runStartupGraph(tasks);
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "startup: " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms, " << pipelineCount
+            << " pipelines in " << pipelineCreateTime << " ms ("
+            << (pipelineCacheLoaded > 0 ? "warm pipeline cache, " + std::to_string(pipelineCacheLoaded / 1024) + " KB" : std::string("cold")) << ")" << std::endl;
+        allocator.printStatistics();
+    }
+
+    // ߳ûпִеĽڵʱ̳߳ظɻڵ쳣Ľڵڵ߳׳
+    void runStartupGraph(std::vector<StartupTask>& tasks) {
+        TaskPool* pool = getTaskPool();
+        auto origin = std::chrono::high_resolution_clock::now();
+        std::vector<std::atomic<bool>> finished(tasks.size());
+        std::vector<std::exception_ptr> errors(tasks.size());
+        std::vector<bool> started(tasks.size(), false);
+        TaskGroup group;
+
+        auto execute = [&](size_t i) {
+            tasks[i].start = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - origin).count();
+            try {
+                tasks[i].run();
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+            tasks[i].end = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - origin).count();
+            finished[i] = true;
+        };
+        auto ready = [&](size_t i) {
+            for (size_t dependency : tasks[i].dependencies) {
+                if (!finished[dependency]) return false;
+            }
+            return !started[i];
+        };
+        auto failed = [&]() {
+            for (size_t i = 0; i < tasks.size(); i++) {
+                if (finished[i] && errors[i]) return errors[i];
+            }
+            return std::exception_ptr();
+        };
+
+        size_t remaining = tasks.size();
+        while (remaining > 0 && !failed()) {
+            bool progressed = false;
+            for (size_t i = 0; i < tasks.size(); i++) {
+                if (!ready(i)) continue;
+                started[i] = true;
+                remaining--;
+                progressed = true;
+                if (tasks[i].mainThread) {
+                    execute(i);
+                    break;
+                }
+                pool->spawn(group, [&execute, i]() { execute(i); });
+            }
+            if (!progressed && !pool->runPending()) {
+                std::this_thread::yield();
+            }
+        }
+        pool->wait(group);
+        if (std::exception_ptr error = failed()) {
+            std::rethrow_exception(error);
+        }
+
+        // ؼ·Ľڵ㿪ʼÿ˵
+        double serial = 0.0;
+        std::cout << "startup timeline (ms):" << std::endl;
+        for (const StartupTask& task : tasks) {
+            serial += task.end - task.start;
+            std::cout << "  " << task.name << " (" << (task.mainThread ? "main" : "pool") << "): " << task.start << " - " << task.end
+                << ", " << task.end - task.start << " ms" << std::endl;
+        }
+        auto latest = [&](const std::vector<size_t>& candidates) {
+            return *std::max_element(candidates.begin(), candidates.end(), [&](size_t a, size_t b) { return tasks[a].end < tasks[b].end; });
+        };
+        std::vector<size_t> all(tasks.size());
+        std::iota(all.begin(), all.end(), size_t(0));
+        std::vector<const char*> path;
+        for (size_t i = latest(all); ; i = latest(tasks[i].dependencies)) {
+            path.push_back(tasks[i].name);
+            if (tasks[i].dependencies.empty()) break;
+        }
+        std::cout << "critical path:";
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            std::cout << (it == path.rbegin() ? " " : " -> ") << *it;
+        }
+        std::cout << ", " << tasks[latest(all)].end << " ms (" << serial << " ms if run one after another)" << std::endl;
+    }
+
+    void mainLoop() {
+        while (!glfwWindowShouldClose(window)) {
+            glfwPollEvents();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+    }
+
+    void cleanupSwapChain() {
+        for (auto imageView : swapChainImageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
+    }
+
+    void cleanup() {
+        if (!headless) {
+            cleanupSwapChain();
+        }
+
+        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+
+        vkDestroyFramebuffer(device, changeFramebuffer, nullptr);
+        vkDestroySampler(device, changSampler, nullptr);
+        vkDestroyImageView(device, changeImageView, nullptr);
+        destroyImage(changeImage, changeImageMemory);
+        vkDestroyImageView(device, compensationImageView, nullptr);
+        destroyImage(compensationImage, compensationImageMemory);
+        vkDestroyImageView(device, sampleCountImageView, nullptr);
+        destroyImage(sampleCountImage, sampleCountImageMemory);
+
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+
+        if (dynamicGeometry && instanceCount == 0) {
+            if (rebuildJob.valid()) rebuildJob.wait();
+            destroyDynamicRefit();
+        }
+
+        destroyTonemap();
+        destroyWavefront();
+
+        destroyBuffer(instanceBuffer, instanceBufferMemory);
+        destroyBuffer(resourceBuffer, resourceBufferMemory);
+        destroyBuffer(lightBuffer, lightBufferMemory);
+        destroyBuffer(screenTrianglesBuffer, screenTrianglesBufferMemory);
+        destroyBuffer(statsBuffer, statsBufferMemory);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            vkDestroyFence(device, inFlightFences[i], nullptr);
+        }
+
+        vkDestroyQueryPool(device, profiler.queryPool, nullptr);
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        allocator.destroy();
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        if (!headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
+        vkDestroyInstance(instance, nullptr);
+
+        if (!headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+    }
+
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwWaitEvents();
+        }
+
+        vkDeviceWaitIdle(device);
+
+        cleanupSwapChain();
+        createSwapChain();
+        createImageViews();
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Vulkan Ray Tracing";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_0;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void createSurface() {
+        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create window surface!");
+        }
+    }
+
+    void pickPhysicalDevice() {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0) {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        for (const auto& device : devices) {
+            if (isDeviceSuitable(device)) {
+                physicalDevice = device;
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+    }
+
+    void createLogicalDevice() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+        float queuePriority = 1.0f;
+        for (uint32_t queueFamily : uniqueQueueFamilies) {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        const std::vector<const char*>& extensions = requiredDeviceExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    }
+
+    void createSwapChain() {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        // ǰ· changeImage blit ͼ
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+        if (indices.graphicsFamily != indices.presentFamily) {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        }
+        else {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainImages.size());
+
+        for (uint32_t i = 0; i < swapChainImages.size(); i++) {
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+
+    void createRenderPass() {
+        //changeAttachment:ÿһ֡ºͶȡۻͼǸ
+        VkAttachmentDescription changeAttachment{};
+        changeAttachment.format = ACCUMULATION_FORMAT;
+        changeAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        changeAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        changeAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        changeAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        changeAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        changeAttachment.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+        changeAttachment.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkAttachmentReference changeAttachmentRef{};
+        changeAttachmentRef.attachment = 0;
+        changeAttachmentRef.layout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &changeAttachmentRef;
+        subpass.pDepthStencilAttachment = nullptr;
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        // һ֡ɫӳ changeImage ֮д룻һ֡ƬɫдĲһ֡Ҫ
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependency.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        std::array<VkAttachmentDescription, 1> attachments = { changeAttachment };
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createDescriptorSetLayout() {
+        // ֻҶ˳ԤȡΣԭ 0~2 Ķ㡢αŲٰ󶨸Ƭɫ
+        VkDescriptorSetLayoutBinding trianglePositionLayoutBinding = {
+            0, // binding
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            1,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            nullptr
+        };
+        VkDescriptorSetLayoutBinding triangleShadingLayoutBinding = {
+            1, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding lightLayoutBinding = {
+           2, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding BVHLayoutBinding = {
+           3, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+
+        VkDescriptorSetLayoutBinding samplerLayoutBinding = {
+            4,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            1,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            nullptr
+        };
+
+        VkDescriptorSetLayoutBinding wideBVHLayoutBinding = {
+           5, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding statsLayoutBinding = {
+           6, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding instanceLayoutBinding = {
+           7, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding tlasLayoutBinding = {
+           8, // binding
+           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        // ۻĲ벨ǰ·ͬ
+        VkDescriptorSetLayoutBinding compensationLayoutBinding = {
+           COMPENSATION_BINDING,
+           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+        VkDescriptorSetLayoutBinding sampleCountLayoutBinding = {
+           SAMPLE_COUNT_BINDING,
+           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+           1,
+           VK_SHADER_STAGE_FRAGMENT_BIT,
+           nullptr
+        };
+
+        std::array<VkDescriptorSetLayoutBinding, 11> layoutBindings{ trianglePositionLayoutBinding, triangleShadingLayoutBinding, lightLayoutBinding, BVHLayoutBinding ,samplerLayoutBinding, wideBVHLayoutBinding, statsLayoutBinding, instanceLayoutBinding, tlasLayoutBinding, compensationLayoutBinding, sampleCountLayoutBinding };
+        VkDescriptorSetLayoutCreateInfo descLayoutInfo = {
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            nullptr,
+            0,
+            static_cast<uint32_t>(layoutBindings.size()),
+            layoutBindings.data()
+        };
+
+        if (vkCreateDescriptorSetLayout(device, &descLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    TraceSpecialization traceSpecialization() const {
+        return { bvhSettings.width, traversalStats ? VK_TRUE : VK_FALSE, instanceCount > 0 ? VK_TRUE : VK_FALSE, shortStackTraversal ? VK_TRUE : VK_FALSE,
+            nextEventEstimation ? VK_TRUE : VK_FALSE, TRAVERSAL_STACK_SIZE, tlasStackSize() };
+    }
+
+    // 볡дֻܰʵƣλ֣Ϊ ceil(log2(Ҷ))
+    // ʱÿһֵܽڵ㣬ټջӽڵ
+    int32_t tlasStackSize() const {
+        size_t leaves = static_cast<size_t>(instanceCount) + 1;    // ģʵ Cornell box
+        int32_t depth = 0;
+        while ((size_t(1) << depth) < leaves) depth++;
+        return depth + 1;
+    }
+
+    // صĽṹ datadata ڴ֮
+    static VkSpecializationInfo traceSpecializationInfo(const TraceSpecialization& data) {
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(TRACE_SPECIALIZATION_ENTRIES.size());
+        specializationInfo.pMapEntries = TRACE_SPECIALIZATION_ENTRIES.data();
+        specializationInfo.dataSize = sizeof(data);
+        specializationInfo.pData = &data;
+        return specializationInfo;
+    }
+
+    void recordPipelineTime(std::chrono::high_resolution_clock::time_point startTime) {
+        pipelineCreateTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        pipelineCount++;
+    }
+
+    // ļͷ뵱ǰ豸ʱÿջ棻ԼҲڵͷȵľļ
+    void createPipelineCache() {
+        if (!pipelineCacheEnabled) return;
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        MappedFile file;
+        const void* initialData = nullptr;
+        if (file.open(PIPELINE_CACHE_PATH)) {
+            auto reject = [&](const char* reason) {
+                std::cout << "pipeline cache: ignoring " << PIPELINE_CACHE_PATH << " (" << reason << ")" << std::endl;
+            };
+            PipelineCacheHeader header;
+            if (file.size() < sizeof(header)) reject("truncated header");
+            else {
+                memcpy(&header, file.data(), sizeof(header));
+                const char* data = file.data() + sizeof(header);
+                if (memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic)) != 0) reject("bad magic");
+                else if (header.version != PIPELINE_CACHE_VERSION) reject("version mismatch");
+                else if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) reject("different device");
+                else if (header.driverVersion != properties.driverVersion) reject("driver version mismatch");
+                else if (memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) reject("pipeline cache UUID mismatch");
+                else if (file.size() != sizeof(header) + header.dataSize) reject("size mismatch");
+                else if (hashBytes(data, header.dataSize) != header.checksum) reject("checksum mismatch");
+                else {
+                    initialData = data;
+                    pipelineCacheLoaded = header.dataSize;
+                }
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = pipelineCacheLoaded;
+        cacheInfo.pInitialData = initialData;
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    // 볡һдʱļٸ
+    void savePipelineCache() {
+        if (pipelineCache == VK_NULL_HANDLE) return;
+        size_t size = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+        data.resize(size);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        PipelineCacheHeader header{};
+        memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = PIPELINE_CACHE_VERSION;
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = size;
+        header.checksum = hashBytes(data.data(), size);
+
+        std::error_code error;
+        std::filesystem::create_directories(SCENE_CACHE_DIR, error);
+        std::string tempPath = PIPELINE_CACHE_PATH + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), (std::streamsize)size);
+            if (!file) {
+                std::cout << "pipeline cache: cannot write " << tempPath << std::endl;
+                return;
+            }
+        }
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error) {
+            std::cout << "pipeline cache: cannot replace " << PIPELINE_CACHE_PATH << ": " << error.message() << std::endl;
+        }
+    }
+
+    void createGraphicsPipeline() {
+        auto vertShaderCode = readFile("shaders/vert.spv");
+        auto fragShaderCode = readFile("shaders/frag.spv");
+
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        TraceSpecialization specializationData = traceSpecialization();
+        VkSpecializationInfo specializationInfo = traceSpecializationInfo(specializationData);
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_FALSE;
+        depthStencil.depthWriteEnable = VK_FALSE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_NEVER;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState changeAttachment{};
+        changeAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        changeAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &changeAttachment;
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT; // ڶƬɫ
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        recordPipelineTime(startTime);
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    }
+
+    // changeImage 潻ؽֻ֡һ
+    void createChangeFramebuffer() {
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &changeImageView;
+        framebufferInfo.width = changeImageExtent.width;
+        framebufferInfo.height = changeImageExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &changeFramebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+
+    void createCommandPool() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics command pool!");
+        }
+    }
+
+    void createChangeImgResources() {
+        VkFormat changeImgFormat = ACCUMULATION_FORMAT;
+        changeImageExtent = headless ? VkExtent2D{ renderWidth, renderHeight } : swapChainExtent;
+
+        createImage(changeImageExtent.width, changeImageExtent.height, changeImgFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT |VK_IMAGE_USAGE_STORAGE_BIT| VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, changeImage, changeImageMemory);
+        changeImageView = createImageView(changeImage, changeImgFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        transitionImageLayout(changeImage, changeImgFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        createImage(changeImageExtent.width, changeImageExtent.height, ACCUMULATION_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compensationImage, compensationImageMemory);
+        compensationImageView = createImageView(compensationImage, ACCUMULATION_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+        transitionImageLayout(compensationImage, ACCUMULATION_FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        createImage(changeImageExtent.width, changeImageExtent.height, SAMPLE_COUNT_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sampleCountImage, sampleCountImageMemory);
+        sampleCountImageView = createImageView(sampleCountImage, SAMPLE_COUNT_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+        transitionImageLayout(sampleCountImage, SAMPLE_COUNT_FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        // ͡ 0 ʼ
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        VkClearColorValue zero{};
+        VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        for (VkImage image : { changeImage, compensationImage, sampleCountImage }) {
+            vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+        }
+        endSingleTimeCommands(commandBuffer);
+
+        // ɫ texelFetch ȡ32 λʽҪ֧Թ
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &changSampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
+                return format;
+            }
+            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkFormat findDepthFormat() {
+        return findSupportedFormat(
+            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
+    bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspectFlags;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+
+        return imageView;
+    }
+
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        // еͼ뻺һ
+        imageMemory = allocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), tiling == VK_IMAGE_TILING_OPTIMAL, MemoryUsage::Resident);
+        vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
+    }
+
+    void destroyImage(VkImage image, Allocation& imageMemory) {
+        vkDestroyImage(device, image, nullptr);
+        allocator.free(imageMemory);
+    }
+
+    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkPipelineStageFlags sourceStage;
+        VkPipelineStageFlags destinationStage;
+
+        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+        else {
+            throw std::invalid_argument("unsupported layout transition!");
+        }
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            sourceStage, destinationStage,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
+
+        endSingleTimeCommands(commandBuffer);
+    }
+
+    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = {
+            width,
+            height,
+            1
+        };
+
+        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        endSingleTimeCommands(commandBuffer);
+    }
+
+    void createScreenQuad() {
+        Vertex vertex{};
+        vertex.pos = { -1,1,0.5 }; screenVertices.push_back(vertex);
+        vertex.pos = { 1,1,0.5 }; screenVertices.push_back(vertex);
+        vertex.pos = { 1,-1,0.5 }; screenVertices.push_back(vertex);
+        vertex.pos = { -1,-1,0.5 }; screenVertices.push_back(vertex);
+
+        screenIndices = { 0,1,2,0,2,3 };
+    }
+
+    // лʱ loadModel ͽcreateResourceBuffer ֱӴӳĻļ
+    void loadScene() {
+        bool useCache = sceneCacheEnabled && !isGPUBuilder(bvhSettings.builder) && !bvhSettings.compare && !objBenchmark && !dynamicGeometry && instanceCount == 0;
+        uint64_t key = 0;
+        std::string cachePath;
+        if (useCache) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            key = sceneCacheKey();
+            cachePath = SCENE_CACHE_DIR + "/" + std::filesystem::path(modelPath).stem().string() + "-" + hexString(key) + ".scene";
+            if (openSceneCache(cachePath, key)) {
+                auto endTime = std::chrono::high_resolution_clock::now();
+                std::cout << "scene cache hit: " << cachePath << " (" << sceneCache.size() / (1024.0 * 1024.0) << " MB) in "
+                    << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+                return;
+            }
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        loadModel();
+        buildBVH();
+        sceneCounts = { vertices.size(), indices.size(), triangles.size(), bvhNodeCount, wideBVHNodes.size() };
+        if (dynamicGeometry && instanceCount == 0) {
+            // ̨ؽڵܲͬڵԤ
+            sceneCounts.BVHNodes = std::max(bvhNodeCount, 2 * triangles.size() - 1);
+        }
+        auto buildTime = std::chrono::high_resolution_clock::now();
+
+        if (useCache) {
+            bool written = writeSceneCache(cachePath, key);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            std::cout << "scene cache miss: load and build " << std::chrono::duration<double, std::milli>(buildTime - startTime).count() << " ms";
+            if (written) {
+                std::cout << ", wrote " << cachePath << " in " << std::chrono::duration<double, std::milli>(endTime - buildTime).count() << " ms";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    static std::string hexString(uint64_t value) {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+        return text;
+    }
+
+    // ģļ + ӰĽ + 汾
+    uint64_t sceneCacheKey() {
+        MappedFile model;
+        if (!model.open(modelPath)) {
+            throw std::runtime_error("failed to open model: " + modelPath);
+        }
+        uint64_t key = hashBytes(model.data(), model.size());
+
+        uint32_t params[] = {
+            SCENE_CACHE_VERSION,
+            static_cast<uint32_t>(bvhSettings.builder),
+            static_cast<uint32_t>(bvhSettings.leafSize),
+            static_cast<uint32_t>(bvhSettings.binCount[0]),
+            static_cast<uint32_t>(bvhSettings.binCount[1]),
+            static_cast<uint32_t>(bvhSettings.binCount[2]),
+            static_cast<uint32_t>(bvhSettings.width),
+            static_cast<uint32_t>(objLoader),
+            static_cast<uint32_t>(sizeof(Vertex)),
+            static_cast<uint32_t>(sizeof(BVHNode)),
+            static_cast<uint32_t>(sizeof(WideBVHChild)),
+            static_cast<uint32_t>(sizeof(TrianglePositions)),
+            static_cast<uint32_t>(sizeof(TriangleShading))
+        };
+        key = hashBytes(params, sizeof(params), key);
+        return hashBytes(modelPath.data(), modelPath.size(), key);
+    }
+
+    // resourceBuffer иδϣ֮
+    uint64_t checksumResourceImage(const std::array<const void*, 7>& sources) {
+        const std::array<const BufferRegion*, 7> regions = {
+            &resourceLayout.vertices, &resourceLayout.indices, &resourceLayout.triangles, &resourceLayout.BVHNodes,
+            &resourceLayout.wideNodes, &resourceLayout.trianglePositions, &resourceLayout.triangleShading
+        };
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < regions.size(); i++) {
+            checksum = hashBytes(sources[i], (size_t)regions[i]->size, checksum);
+        }
+        return checksum;
+    }
+
+    bool openSceneCache(const std::string& path, uint64_t key) {
+        if (!sceneCache.open(path)) return false;
+
+        auto reject = [&](const char* reason) {
+            std::cout << "scene cache: ignoring " << path << " (" << reason << ")" << std::endl;
+            sceneCache.close();
+            sceneCounts = ResourceCounts{};
+            bvhNodeCount = 0;
+            return false;
+        };
+
+        SceneCacheHeader header;
+        if (sceneCache.size() < sizeof(header)) return reject("truncated header");
+        memcpy(&header, sceneCache.data(), sizeof(header));
+        if (memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) != 0) return reject("bad magic");
+        if (header.version != SCENE_CACHE_VERSION) return reject("version mismatch");
+        if (header.alignment != RESOURCE_ALIGNMENT) return reject("alignment mismatch");
+        if (header.key != key) return reject("key mismatch");
+
+        sceneCounts = { header.counts[0], header.counts[1], header.counts[2], header.counts[3], header.counts[4] };
+        bvhNodeCount = sceneCounts.BVHNodes;
+        computeResourceLayout();
+        if (header.payloadSize != resourceLayout.size || sceneCache.size() != sizeof(header) + header.payloadSize) return reject("size mismatch");
+
+        const char* payload = sceneCache.data() + sizeof(header);
+        std::array<const void*, 7> sources = {
+            payload + resourceLayout.vertices.offset, payload + resourceLayout.indices.offset, payload + resourceLayout.triangles.offset,
+            payload + resourceLayout.BVHNodes.offset, payload + resourceLayout.wideNodes.offset,
+            payload + resourceLayout.trianglePositions.offset, payload + resourceLayout.triangleShading.offset
+        };
+        if (checksumResourceImage(sources) != header.checksum) return reject("checksum mismatch");
+        return true;
+    }
+
+    // дʱļٸ;˳°
+    bool writeSceneCache(const std::string& path, uint64_t key) {
+        computeResourceLayout();
+        std::array<const void*, 7> sources = {
+            vertices.data(), indices.data(), triangles.data(), BVHNodes.data(),
+            wideBVHNodes.data(), trianglePositions.data(), triangleShading.data()
+        };
+        std::array<const BufferRegion*, 7> regions = {
+            &resourceLayout.vertices, &resourceLayout.indices, &resourceLayout.triangles, &resourceLayout.BVHNodes,
+            &resourceLayout.wideNodes, &resourceLayout.trianglePositions, &resourceLayout.triangleShading
+        };
+
+        SceneCacheHeader header{};
+        memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = SCENE_CACHE_VERSION;
+        header.alignment = static_cast<uint32_t>(RESOURCE_ALIGNMENT);
+        header.key = key;
+        header.counts[0] = sceneCounts.vertices;
+        header.counts[1] = sceneCounts.indices;
+        header.counts[2] = sceneCounts.triangles;
+        header.counts[3] = sceneCounts.BVHNodes;
+        header.counts[4] = sceneCounts.wideNodes;
+        header.payloadSize = resourceLayout.size;
+        header.checksum = checksumResourceImage(sources);
+
+        std::error_code error;
+        std::filesystem::create_directories(SCENE_CACHE_DIR, error);
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cout << "scene cache: cannot write " << tempPath << std::endl;
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            const std::vector<char> padding(RESOURCE_ALIGNMENT, 0);
+            VkDeviceSize written = 0;
+            for (size_t i = 0; i < regions.size(); i++) {
+                file.write(padding.data(), (std::streamsize)(regions[i]->offset - written));
+                file.write(static_cast<const char*>(sources[i]), (std::streamsize)regions[i]->size);
+                written = regions[i]->offset + regions[i]->size;
+            }
+            file.write(padding.data(), (std::streamsize)(resourceLayout.size - written));
+            if (!file) {
+                std::cout << "scene cache: failed to write " << tempPath << std::endl;
+                return false;
+            }
+        }
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::cout << "scene cache: cannot replace " << path << ": " << error.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void loadModel() {
+        if (objBenchmark) {
+            benchmarkOBJLoaders();
+        }
+        if (objLoader == OBJLoaderType::Builtin) {
+            loadOBJ(modelPath, vertices, indices);
+        }
+        else {
+            loadOBJWithTinyObj(modelPath, vertices, indices);
+        }
+        modelVertexCount = vertices.size();
+        modelTriangleCount = indices.size() / 3;
+
+        uint32_t index = vertices.size();
+        Vertex vertex{};
+        vertex.pos = { 1,-1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,-1,1 };vertex.color = { 1,1,1 };vertices.push_back(vertex);
+        vertex.pos = { 1,-1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+
+        vertex.pos = { 1,1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+        vertex.pos = { 1,1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+
+        vertex.pos = { -1,1,-1 }; vertex.color = { 1,0.5,0.5 };  vertices.push_back(vertex);
+        vertex.pos = { 1,1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+
+        vertex.pos = { -1,1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,-1 }; vertex.color = { 0.5,0.5,1 };  vertices.push_back(vertex);
+        vertex.pos = { -1,-1,-1 }; vertex.color = { 0.5,0.5,1 };  vertices.push_back(vertex);
+        vertex.pos = { -1,-1,-1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,-1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
+        vertex.pos = { -1,1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
+
+        vertex.pos = { 1,1,1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,1,-1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,-1,-1 }; vertex.color = { 0,1,1 };vertices.push_back(vertex);
+        vertex.pos = { 1,-1,-1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,-1,1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
+        vertex.pos = { 1,1,1 }; vertex.color = { 0,1,1 };vertices.push_back(vertex);
+
+        vertex.pos = { 0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        vertex.pos = { -0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        vertex.pos = { -0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        vertex.pos = { 0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        vertex.pos = { 0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        vertex.pos = { -0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
+        
+
+        std::vector<uint32_t> v = { index,index + 1,index + 2,index + 3,index + 4,index + 5 ,index + 6,index + 7,index + 8 ,index + 9,index + 10,index + 11,
+        index + 12,index + 13,index + 14 ,index + 15,index + 16,index + 17 ,index + 18,index + 19,index + 20 ,index + 21,index + 22,index + 23 ,
+        index + 24,index + 25,index + 26 ,index + 27,index + 28,index + 29 ,index + 30,index + 31,index + 32 ,index + 33,index + 34,index + 35 };
+        indices.insert(indices.end(), v.begin(), v.end());
+        for (int i = 0; i < indices.size(); i += 3)
+            triangles.push_back(i / 3);
+    }
+
+    //   x  ΪνVose ѡÿεĸ书ʳ
+    void buildLightTable(const Vertex* sceneVertices, const uint32_t* sceneIndices, size_t triangleCount) {
+        emissiveTriangles.clear();
+        std::vector<double> power;
+        double totalPower = 0.0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const Vertex& v0 = sceneVertices[sceneIndices[3 * t]];
+            if (!v0.emissive) continue;
+            const Vertex& v1 = sceneVertices[sceneIndices[3 * t + 1]];
+            const Vertex& v2 = sceneVertices[sceneIndices[3 * t + 2]];
+            double area = 0.5 * glm::length(glm::cross(v1.pos - v0.pos, v2.pos - v0.pos));
+            double weight = area * glm::dot(v0.color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+            if (weight <= 0.0) continue;
+
+            EmissiveTriangle light{};
+            light.p0 = v0.pos;
+            light.p1 = v1.pos;
+            light.p2 = v2.pos;
+            light.emission = v0.color;
+            emissiveTriangles.push_back(light);
+            power.push_back(weight);
+            totalPower += weight;
+        }
+        size_t n = emissiveTriangles.size();
+        lightHeader = { static_cast<uint32_t>(n), static_cast<float>(totalPower), { 0, 0 } };
+
+        // ʵƽһƽ룬ÿָһ
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = power[i] * n / totalPower;
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back();
+            small.pop_back();
+            uint32_t l = large.back();
+            emissiveTriangles[s].threshold = static_cast<float>(scaled[s]);
+            emissiveTriangles[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // ʣµռԼһ small еҲһ
+        for (std::vector<uint32_t>* rest : { &small, &large }) {
+            for (uint32_t i : *rest) {
+                emissiveTriangles[i].threshold = 1.0f;
+                emissiveTriangles[i].alias = i;
+            }
+        }
+        std::cout << "light table: " << n << " emissive triangles, total power " << totalPower << std::endl;
+    }
+
+    // ģͳһƽƵУֽʽ
+    static Vertex makeModelVertex(const float* position) {
+        Vertex vertex{};
+
+        vertex.pos = {
+            position[0] * 6 + 0.2,
+            position[1] * 6 - 1,
+            position[2] * 6
+        };
+
+        vertex.color = { 1,0.6,0.8 };
+        vertex.roughness = 0.5;
+        return vertex;
+    }
+
+    void loadOBJWithTinyObj(const std::string& path, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices) {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+            throw std::runtime_error(warn + err);
+        }
+
+        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                Vertex vertex = makeModelVertex(&attrib.vertices[3 * index.vertex_index]);
+
+                if (uniqueVertices.count(vertex) == 0) {
+                    uniqueVertices[vertex] = static_cast<uint32_t>(outVertices.size());
+                    outVertices.push_back(vertex);
+                }
+
+                outIndices.push_back(uniqueVertices[vertex]);
+            }
+        }
+    }
+
+    // ýӳļжֿ飬ȲͳƸ v/vt/vn 
+    // ǰ׺͵õȫ±ַٲнļ˳±Ԫȥ
+    void loadOBJ(const std::string& path, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices) {
+        MappedFile file;
+        if (!file.open(path)) {
+            throw std::runtime_error("failed to open model: " + path);
+        }
+
+        std::vector<OBJChunk> chunks;
+        const char* fileEnd = file.data() + file.size();
+        for (const char* p = file.data(); p < fileEnd;) {
+            const char* end = p + std::min(OBJ_CHUNK_SIZE, static_cast<size_t>(fileEnd - p));
+            if (end < fileEnd) end = nextLine(end - 1, fileEnd);
+            chunks.push_back({ p, end });
+            p = end;
+        }
+
+        TaskPool* pool = (chunks.size() > 1 && resolveThreadCount(threadCount) > 1) ? getTaskPool() : nullptr;
+        auto forEachChunk = [&](auto&& fn) {
+            if (pool) {
+                pool->parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, size_t) {
+                    for (size_t i = begin; i < end; i++) fn(chunks[i]);
+                });
+            }
+            else {
+                for (OBJChunk& chunk : chunks) fn(chunk);
+            }
+        };
+
+        forEachChunk(countOBJChunk);
+        size_t positionCount = 0, texcoordCount = 0, normalCount = 0;
+        for (OBJChunk& chunk : chunks) {
+            chunk.positionBase = positionCount;
+            chunk.texcoordBase = texcoordCount;
+            chunk.normalBase = normalCount;
+            positionCount += chunk.positions;
+            texcoordCount += chunk.texcoords;
+            normalCount += chunk.normals;
+        }
+
+        std::vector<float> positions(3 * positionCount);
+        forEachChunk([&](OBJChunk& chunk) { parseOBJChunk(chunk, positions.data()); });
+
+        size_t cornerCount = 0;
+        for (const OBJChunk& chunk : chunks) {
+            cornerCount += chunk.corners.size();
+        }
+        outIndices.reserve(outIndices.size() + cornerCount);
+        outVertices.reserve(outVertices.size() + positionCount);
+
+        OBJIndexMap uniqueCorners(positionCount);
+        for (const OBJChunk& chunk : chunks) {
+            for (const OBJIndex& corner : chunk.corners) {
+                if (static_cast<size_t>(corner.v) >= positionCount) {
+                    throw std::runtime_error("face references a missing vertex in " + path);
+                }
+                uint32_t next = static_cast<uint32_t>(outVertices.size());
+                uint32_t index = uniqueCorners.insert(corner, next);
+                if (index == next) {
+                    outVertices.push_back(makeModelVertex(&positions[3 * corner.v]));
+                }
+                outIndices.push_back(index);
+            }
+        }
+    }
+
+    // --test-intersectionߺͼ߽¶Ա֮ǰ Moller-Trumbore ˮ󽻣
+    void testIntersection() {
+        std::mt19937 rng(20240611);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto uniform = [&](float a, float b) { return a + (b - a) * unit(rng); };
+        auto randomPoint = [&](float extent) { return glm::vec3(uniform(-extent, extent), uniform(-extent, extent), uniform(-extent, extent)); };
+        const float closest = 100.0f;   //  shader ĳֵͬ
+        const float PI = 3.14159265f;
+
+        auto hitMT = [&](const glm::vec3& origin, const glm::vec3& direction, const TrianglePositions& tri, float& t, glm::vec2& barycentric) {
+            return intersectMollerTrumbore(origin, direction, tri, closest, t, barycentric);
+        };
+        auto hitWT = [&](const glm::vec3& origin, const glm::vec3& direction, const TrianglePositions& tri, float& t, glm::vec2& barycentric) {
+            return intersectWatertight(setupTriangleRay(origin, direction), tri, closest, t, barycentric);
+        };
+        // ֱͳַеθ
+        auto countHits = [&](const glm::vec3& origin, const glm::vec3& direction, const TrianglePositions* tris, int n, std::array<int, 2>& hits) {
+            hits = {};
+            for (int k = 0; k < n; k++) {
+                float t;
+                glm::vec2 barycentric;
+                hits[0] += hitMT(origin, direction, tris[k], t, barycentric) ? 1 : 0;
+                hits[1] += hitWT(origin, direction, tris[k], t, barycentric) ? 1 : 0;
+            }
+        };
+        // ˫¹߷ηߵĵűʾһ
+        auto facing = [](const glm::vec3& direction, const TrianglePositions& tri) {
+            glm::dvec3 p0(tri.p0), p1(tri.p1), p2(tri.p2);
+            return glm::dot(glm::dvec3(direction), glm::cross(p1 - p0, p2 - p0));
+        };
+
+        // 1. ΣĿ [-0.2, 1.2] оȷֲкδиռһ
+        struct RandomCase {
+            TrianglePositions tri;
+            glm::vec3 origin;
+            glm::vec3 direction;
+        };
+        std::vector<RandomCase> cases(1000000);
+        for (RandomCase& c : cases) {
+            c.tri = { randomPoint(1.0f), randomPoint(1.0f), randomPoint(1.0f) };
+            c.origin = randomPoint(4.0f);
+            float u = uniform(-0.2f, 1.2f);
+            float v = uniform(-0.2f, 1.2f);
+            c.direction = c.tri.p0 + u * (c.tri.p1 - c.tri.p0) + v * (c.tri.p2 - c.tri.p0) - c.origin;
+        }
+        // ˫½һߵ룬˵ַķ綼ڱ
+        auto edgeMargin = [](const RandomCase& c) {
+            glm::dvec3 p0(c.tri.p0), d(c.direction);
+            glm::dvec3 e1 = glm::dvec3(c.tri.p1) - p0;
+            glm::dvec3 e2 = glm::dvec3(c.tri.p2) - p0;
+            glm::dvec3 pvec = glm::cross(d, e2);
+            double invDet = 1.0 / glm::dot(e1, pvec);
+            glm::dvec3 tvec = glm::dvec3(c.origin) - p0;
+            double u = glm::dot(tvec, pvec) * invDet;
+            double v = glm::dot(d, glm::cross(tvec, e1)) * invDet;
+            return std::fabs(std::min({ u, v, 1.0 - u - v }));
+        };
+
+        // ƽнǵңʱַǲ̬ģͳ
+        auto grazingSine = [&](const RandomCase& c) {
+            glm::dvec3 p0(c.tri.p0), p1(c.tri.p1), p2(c.tri.p2), d(c.direction);
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            return std::fabs(glm::dot(n, d)) / (glm::length(n) * glm::length(d));
+        };
+
+        int bothHit = 0, bothMiss = 0, onlyMT = 0, onlyWT = 0, grazing = 0;
+        float maxDistanceError = 0.0f, maxBarycentricError = 0.0f;
+        double maxDisagreementMargin = 0.0;
+        for (const RandomCase& c : cases) {
+            float t0, t1;
+            glm::vec2 b0, b1;
+            bool h0 = hitMT(c.origin, c.direction, c.tri, t0, b0);
+            bool h1 = hitWT(c.origin, c.direction, c.tri, t1, b1);
+            if (h0 && h1) {
+                bothHit++;
+                if (grazingSine(c) < 1e-3) {
+                    grazing++;
+                    continue;
+                }
+                maxDistanceError = std::max(maxDistanceError, std::fabs(t0 - t1) / t0);
+                maxBarycentricError = std::max({ maxBarycentricError, std::fabs(b0.x - b1.x), std::fabs(b0.y - b1.y) });
+                continue;
+            }
+            if (!h0 && !h1) {
+                bothMiss++;
+                continue;
+            }
+            (h0 ? onlyMT : onlyWT)++;
+            maxDisagreementMargin = std::max(maxDisagreementMargin, edgeMargin(c));
+        }
+        std::cout << "random: " << cases.size() << " rays, " << bothHit << " both hit, " << bothMiss << " both miss, "
+            << onlyMT << " Moller-Trumbore only, " << onlyWT << " watertight only" << std::endl;
+        std::cout << "random: max relative distance difference " << maxDistanceError << ", max barycentric difference " << maxBarycentricError
+            << " (" << grazing << " grazing hits excluded), disagreements within " << maxDisagreementMargin << " of an edge" << std::endl;
+
+        // ˮÿߵ׼GPU ⲿÿֻһ
+        auto measure = [&](const char* name, auto hit) {
+            int hits = 0;
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (const RandomCase& c : cases) {
+                float t;
+                glm::vec2 barycentric;
+                hits += hit(c.origin, c.direction, c.tri, t, barycentric) ? 1 : 0;
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            double seconds = std::max(std::chrono::duration<double>(endTime - startTime).count(), 1e-9);
+            std::cout << name << cases.size() / seconds / 1e6 << " Mtests/s (" << hits << " hits)" << std::endl;
+        };
+        measure("random: Moller-Trumbore ", hitMT);
+        measure("random: watertight ", hitWT);
+
+        // 2. һߵΣ׼ϵĵ㣻©ʾߴӷﴩ
+        const int edgeRays = 200000;
+        std::array<int, 2> edgeLeaks{}, edgeDoubles{};
+        for (int i = 0; i < edgeRays; ) {
+            glm::vec3 a = randomPoint(1.0f), b = randomPoint(1.0f), c = randomPoint(1.0f);
+            glm::vec3 d = b + c - a + randomPoint(0.5f);
+            TrianglePositions pair[2] = { { a, b, c }, { c, b, d } };
+            glm::vec3 origin = randomPoint(4.0f);
+            glm::vec3 direction = b + unit(rng) * (c - b) - origin;
+            // γߵ治ͬʱߣ߶ȷ
+            if (facing(direction, pair[0]) * facing(direction, pair[1]) <= 0.0) continue;
+            i++;
+            std::array<int, 2> hits;
+            countHits(origin, direction, pair, 2, hits);
+            for (int m = 0; m < 2; m++) {
+                edgeLeaks[m] += hits[m] == 0 ? 1 : 0;
+                edgeDoubles[m] += hits[m] > 1 ? 1 : 0;
+            }
+        }
+        std::cout << "shared edges: " << edgeRays << " rays, leaks Moller-Trumbore " << edgeLeaks[0] << " / watertight " << edgeLeaks[1]
+            << ", double hits " << edgeDoubles[0] << " / " << edgeDoubles[1] << std::endl;
+
+        // 3. ΧһΣ׼㣻ֻͷת kz ȡֵ
+        const int fanRays = 100000;
+        const int fanSize = 6;
+        std::array<int, 2> vertexLeaks{};
+        for (int i = 0; i < fanRays; ) {
+            int axis = static_cast<int>(rng() % 3);
+            glm::vec3 flip(rng() & 1 ? 1.0f : -1.0f, rng() & 1 ? 1.0f : -1.0f, rng() & 1 ? 1.0f : -1.0f);
+            auto orient = [&](const glm::vec3& p) { return flip * glm::vec3(p[axis], p[(axis + 1) % 3], p[(axis + 2) % 3]); };
+
+            glm::vec3 center = randomPoint(1.0f);
+            std::array<glm::vec3, fanSize> ring;
+            float start = uniform(0.0f, 2.0f * PI);
+            for (int k = 0; k < fanSize; k++) {
+                float angle = start + (k + uniform(-0.3f, 0.3f)) * 2.0f * PI / fanSize;
+                float radius = uniform(0.5f, 1.5f);
+                ring[k] = orient(center + glm::vec3(radius * std::cos(angle), radius * std::sin(angle), uniform(-0.3f, 0.3f)));
+            }
+            glm::vec3 apex = orient(center);
+            std::array<TrianglePositions, fanSize> fan;
+            for (int k = 0; k < fanSize; k++) {
+                fan[k] = { apex, ring[k], ring[(k + 1) % fanSize] };
+            }
+            glm::vec3 origin = orient(center + glm::vec3(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(2.0f, 4.0f)));
+            glm::vec3 direction = apex - origin;
+            bool closed = true;
+            for (int k = 1; k < fanSize; k++) {
+                closed = closed && facing(direction, fan[0]) * facing(direction, fan[k]) > 0.0;
+            }
+            if (!closed) continue;
+            i++;
+            std::array<int, 2> hits;
+            countHits(origin, direction, fan.data(), fanSize, hits);
+            for (int m = 0; m < 2; m++) {
+                vertexLeaks[m] += hits[m] == 0 ? 1 : 0;
+            }
+        }
+        std::cout << "shared vertices: " << fanRays << " rays, leaks Moller-Trumbore " << vertexLeaks[0] << " / watertight " << vertexLeaks[1] << std::endl;
+
+        // 4. ƽӹĹߣ񶼿Խܣֵ
+        const int grazingRays = 100000;
+        std::array<int, 2> grazingHits{}, invalid{};
+        for (int i = 0; i < grazingRays; i++) {
+            TrianglePositions tri = { randomPoint(1.0f), randomPoint(1.0f), randomPoint(1.0f) };
+            glm::vec3 e1 = tri.p1 - tri.p0;
+            glm::vec3 e2 = tri.p2 - tri.p0;
+            glm::vec3 origin = tri.p0 + uniform(-2.0f, -1.0f) * e1 + uniform(-2.0f, -1.0f) * e2;
+            glm::vec3 direction = tri.p0 + 0.25f * e1 + 0.25f * e2 - origin;
+            float t;
+            glm::vec2 b;
+            for (int m = 0; m < 2; m++) {
+                bool hit = m == 0 ? hitMT(origin, direction, tri, t, b) : hitWT(origin, direction, tri, t, b);
+                if (!hit) continue;
+                grazingHits[m]++;
+                invalid[m] += std::isfinite(t) && std::isfinite(b.x) && std::isfinite(b.y) ? 0 : 1;
+            }
+        }
+        std::cout << "in-plane rays: " << grazingRays << " rays, hits Moller-Trumbore " << grazingHits[0] << " / watertight " << grazingHits[1]
+            << ", non-finite results " << invalid[0] << " / " << invalid[1] << std::endl;
+
+        // 5. ˻Σ㹲߻غϣӦñ
+        const int degenerateRays = 100000;
+        std::array<int, 2> degenerateHits{};
+        for (int i = 0; i < degenerateRays; i++) {
+            glm::vec3 p0 = randomPoint(1.0f);
+            glm::vec3 p1 = i % 2 == 0 ? randomPoint(1.0f) : p0;
+            TrianglePositions tri = { p0, p1, p0 + uniform(-1.0f, 2.0f) * (p1 - p0) };
+            glm::vec3 origin = randomPoint(4.0f);
+            glm::vec3 direction = p0 + unit(rng) * (p1 - p0) - origin;
+            std::array<int, 2> hits;
+            countHits(origin, direction, &tri, 1, hits);
+            degenerateHits[0] += hits[0];
+            degenerateHits[1] += hits[1];
+        }
+        std::cout << "degenerate triangles: " << degenerateRays << " rays, hits Moller-Trumbore " << degenerateHits[0]
+            << " / watertight " << degenerateHits[1] << std::endl;
+    }
+
+    // ֽʽһΣ涥˶
+    void benchmarkOBJLoaders() {
+        struct LoadResult {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            double milliseconds = 0.0;
+        };
+        // ̳߳صĴʱ
+        if (resolveThreadCount(threadCount) > 1) {
+            getTaskPool();
+        }
+        double megabytes = std::filesystem::file_size(modelPath) / (1024.0 * 1024.0);
+
+        auto run = [&](OBJLoaderType type) {
+            LoadResult result;
+            auto startTime = std::chrono::high_resolution_clock::now();
+            if (type == OBJLoaderType::Builtin) loadOBJ(modelPath, result.vertices, result.indices);
+            else loadOBJWithTinyObj(modelPath, result.vertices, result.indices);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            result.milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+            double seconds = std::max(result.milliseconds, 1e-3) / 1000.0;
+            std::cout << (type == OBJLoaderType::Builtin ? "OBJ builtin: " : "OBJ tinyobj: ") << result.milliseconds << " ms, "
+                << megabytes / seconds << " MB/s, " << result.indices.size() / 3 / seconds / 1e6 << " Mtris/s, "
+                << result.vertices.size() << " vertices" << std::endl;
+            return result;
+        };
+        LoadResult reference = run(OBJLoaderType::TinyObj);
+        LoadResult builtin = run(OBJLoaderType::Builtin);
+
+        if (reference.indices.size() != builtin.indices.size()) {
+            std::cout << "OBJ loaders disagree: " << reference.indices.size() / 3 << " vs " << builtin.indices.size() / 3 << " triangles" << std::endl;
+            return;
+        }
+        float maxError = 0.0f;
+        for (size_t i = 0; i < reference.indices.size(); i++) {
+            glm::vec3 d = glm::abs(reference.vertices[reference.indices[i]].pos - builtin.vertices[builtin.indices[i]].pos);
+            maxError = std::max(maxError, std::max(d.x, std::max(d.y, d.z)));
+        }
+        std::cout << "OBJ builtin speedup " << reference.milliseconds / std::max(builtin.milliseconds, 1e-3)
+            << "x, max position difference " << maxError << std::endl;
+    }
+
+    bool cmpx(const BVHBuildContext& ctx, const uint32_t& t1, const uint32_t& t2) {
+        if (t1 == t2) return false;
+        const std::vector<Vertex>& vertices = ctx.vertices;
+        const std::vector<uint32_t>& triangles = ctx.triangles;
+        glm::vec3 center1 = vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos;
+        glm::vec3 center2 = vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos;
+        if (center1.x = center2.x)   return t1 < t2;
+        return center1.x < center2.x; 
+    }
+    bool cmpy(const BVHBuildContext& ctx, const uint32_t& t1, const uint32_t& t2) {
+        if (t1 == t2) return false;
+        const std::vector<Vertex>& vertices = ctx.vertices;
+        const std::vector<uint32_t>& triangles = ctx.triangles;
+        glm::vec3 center1 = (vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos);
+        glm::vec3 center2 = (vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos);
+        if (center1.y = center2.y)   return t1 < t2;
+        return center1.y < center2.y;
+    }
+    bool cmpz(const BVHBuildContext& ctx, const uint32_t& t1, const uint32_t& t2) {
+        if (t1 == t2) return false;
+        const std::vector<Vertex>& vertices = ctx.vertices;
+        const std::vector<uint32_t>& triangles = ctx.triangles;
+        glm::vec3 center1 = (vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos);
+        glm::vec3 center2 = (vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos);
+        if (center1.z = center2.z)   return t1 < t2;
+        return center1.z < center2.z;
+    }
+
+    int createBVH(BVHBuildContext& ctx, std::vector<BVHNode>& nodes, int l, int r, int n) {
+        if (l > r) return 0;
+        const std::vector<Vertex>& vertices = ctx.vertices;
+        std::vector<uint32_t>& triangles = ctx.triangles;
+        nodes.push_back(BVHNode());
+        int id = nodes.size() - 1;
+        nodes[id].left = nodes[id].right = nodes[id].n = nodes[id].index = 0;
+        glm::vec3 AA = { 3,3,3 };
+        glm::vec3 BB = { -3,-3,-3 };
+        for (int i = l; i <= r; ++i) {
+            // С AA
+            float minx = fmin(vertices[indices[3 * triangles[i]]].pos.x, fmin(vertices[indices[3 * triangles[i] + 1]].pos.x, vertices[indices[3 * triangles[i] + 2]].pos.x));
+            float miny = fmin(vertices[indices[3 * triangles[i]]].pos.y, fmin(vertices[indices[3 * triangles[i] + 1]].pos.y, vertices[indices[3 * triangles[i] + 2]].pos.y));
+            float minz = fmin(vertices[indices[3 * triangles[i]]].pos.z, fmin(vertices[indices[3 * triangles[i] + 1]].pos.z, vertices[indices[3 * triangles[i] + 2]].pos.z));
+            AA.x = fmin(AA.x, minx);
+            AA.y = fmin(AA.y, miny);
+            AA.z = fmin(AA.z, minz);
+            float maxx = fmax(vertices[indices[3 * triangles[i]]].pos.x, fmax(vertices[indices[3 * triangles[i] + 1]].pos.x, vertices[indices[3 * triangles[i] + 2]].pos.x));
+            float maxy = fmax(vertices[indices[3 * triangles[i]]].pos.y, fmax(vertices[indices[3 * triangles[i] + 1]].pos.y, vertices[indices[3 * triangles[i] + 2]].pos.y));
+            float maxz = fmax(vertices[indices[3 * triangles[i]]].pos.z, fmax(vertices[indices[3 * triangles[i] + 1]].pos.z, vertices[indices[3 * triangles[i] + 2]].pos.z));
+            BB.x = fmax(BB.x, maxx);
+            BB.y = fmax(BB.y, maxy);
+            BB.z = fmax(BB.z, maxz);
+        }
+        nodes[id].AA = AA;
+        nodes[id].BB = BB;
+        //  n  Ҷӽڵ
+        if ((r - l + 1) <= n) {
+            nodes[id].n = r - l + 1;
+            nodes[id].index = l;
+            return id;
+        }
+        // ݹ齨(SAHŻ)
+        float Cost = INFINITY;
+        int Axis = 0;
+        int Split = (l + r) / 2;
+        for (int axis = 0; axis < 3; ++axis) {
+            // ֱ xyz 
+            if (axis == 0) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+                return cmpx(ctx, t1, t2);  
+                });
+            if (axis == 1) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+                return cmpy(ctx, t1, t2);  
+                });
+            if (axis == 2) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+                return cmpz(ctx, t1, t2);  
+                });
+            // leftMax[i]: [l, i]  xyz ֵ
+            // leftMin[i]: [l, i] С xyz ֵ
+            std::vector<glm::vec3> leftMax(r - l + 1, glm::vec3(-INFINITY, -INFINITY, -INFINITY));
+            std::vector<glm::vec3> leftMin(r - l + 1, glm::vec3(INFINITY, INFINITY, INFINITY));
+            // ǰ׺ ע i-l Զ뵽± 0
+            for (int i = l; i <= r; i++) {
+                glm::vec3 p1 = vertices[indices[3 * triangles[i]]].pos;
+                glm::vec3 p2 = vertices[indices[3 * triangles[i] + 1]].pos;
+                glm::vec3 p3 = vertices[indices[3 * triangles[i] + 2]].pos;
+
+                int bias = (i == l) ? 0 : 1;  // һԪ⴦
+
+                leftMax[i - l].x = fmax(leftMax[i - l - bias].x, fmax(p1.x, fmax(p2.x, p3.x)));
+                leftMax[i - l].y = fmax(leftMax[i - l - bias].y, fmax(p1.y, fmax(p2.y, p3.y)));
+                leftMax[i - l].z = fmax(leftMax[i - l - bias].z, fmax(p1.z, fmax(p2.z, p3.z)));
+
+                leftMin[i - l].x = fmin(leftMin[i - l - bias].x, fmin(p1.x, fmin(p2.x, p3.x)));
+                leftMin[i - l].y = fmin(leftMin[i - l - bias].y, fmin(p1.y, fmin(p2.y, p3.y)));
+                leftMin[i - l].z = fmin(leftMin[i - l - bias].z, fmin(p1.z, fmin(p2.z, p3.z)));
+            }
+            std::vector<glm::vec3> rightMax(r - l + 1, glm::vec3(-INFINITY, -INFINITY, -INFINITY));
+            std::vector<glm::vec3> rightMin(r - l + 1, glm::vec3(INFINITY, INFINITY, INFINITY));
+            // ׺ ע i-l Զ뵽± 0
+            for (int i = r; i >= l; i--) {
+                glm::vec3 p1 = vertices[indices[3 * triangles[i]]].pos;
+                glm::vec3 p2 = vertices[indices[3 * triangles[i] + 1]].pos;
+                glm::vec3 p3 = vertices[indices[3 * triangles[i] + 2]].pos;
+                int bias = (i == r) ? 0 : 1;  // һԪ⴦
+
+                rightMax[i - l].x = fmax(rightMax[i - l + bias].x, fmax(p1.x, fmax(p2.x, p3.x)));
+                rightMax[i - l].y = fmax(rightMax[i - l + bias].y, fmax(p1.y, fmax(p2.y, p3.y)));
+                rightMax[i - l].z = fmax(rightMax[i - l + bias].z, fmax(p1.z, fmax(p2.z, p3.z)));
+
+                rightMin[i - l].x = fmin(rightMin[i - l + bias].x, fmin(p1.x, fmin(p2.x, p3.x)));
+                rightMin[i - l].y = fmin(rightMin[i - l + bias].y, fmin(p1.y, fmin(p2.y, p3.y)));
+                rightMin[i - l].z = fmin(rightMin[i - l + bias].z, fmin(p1.z, fmin(p2.z, p3.z)));
+            }
+            // Ѱҷָ
+            float cost = INFINITY;
+            int split = l;
+            for (int i = l; i <= r - 1; i++) {
+                float lenx, leny, lenz;
+                //  [l, i]
+                glm::vec3 leftAA = leftMin[i - l];
+                glm::vec3 leftBB = leftMax[i - l];
+                lenx = leftBB.x - leftAA.x;
+                leny = leftBB.y - leftAA.y;
+                lenz = leftBB.z - leftAA.z;
+                float leftS = 2.0 * ((lenx * leny) + (lenx * lenz) + (leny * lenz));
+                float leftCost = leftS * (i - l + 1);
+
+                // Ҳ [i+1, r]
+                glm::vec3 rightAA = rightMin[i + 1 - l];
+                glm::vec3 rightBB = rightMax[i + 1 - l];
+                lenx = rightBB.x - rightAA.x;
+                leny = rightBB.y - rightAA.y;
+                lenz = rightBB.z - rightAA.z;
+                float rightS = 2.0 * ((lenx * leny) + (lenx * lenz) + (leny * lenz));
+                float rightCost = rightS * (r - i);
+
+                // ¼ÿָС
+                float totalCost = leftCost + rightCost;
+                if (totalCost < cost) {
+                    cost = totalCost;
+                    split = i;
+                }
+            }
+            // ¼ÿѴ
+            if (cost < Cost) {
+                Cost = cost;
+                Axis = axis;
+                Split = split;
+            }
+        }
+        // ָ
+        if (Axis == 0) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+            return cmpx(ctx, t1, t2);  // óԱ
+            });
+        if (Axis == 1) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+            return cmpy(ctx, t1, t2);  // óԱ
+            });
+        if (Axis == 2) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this, &ctx](const uint32_t& t1, const uint32_t& t2) {
+            return cmpz(ctx, t1, t2);  // óԱ
+            });
+
+        // ݹ
+        int left = createBVH(ctx, nodes, l, Split, n);
+        int right = createBVH(ctx, nodes, Split + 1, r, n);
+
+        nodes[id].left = left;
+        nodes[id].right = right;
+
+        return id;
+    }
+
+    void buildBVH() {
+        if (dynamicGeometry && (isGPUBuilder(bvhSettings.builder) || bvhSettings.width > 2)) {
+            throw std::runtime_error("--dynamic requires a CPU BVH builder and --bvh-width=2");
+        }
+        if (instanceCount > 0) {
+            if (isGPUBuilder(bvhSettings.builder) || bvhSettings.width > 2) {
+                throw std::runtime_error("--instances requires a CPU BVH builder and --bvh-width=2");
+            }
+            buildMeshBVHs();
+            return;
+        }
+        if (isGPUBuilder(bvhSettings.builder)) {
+            if (triangles.size() >= 2) {
+                //  createResourceBuffer ֮ buildBVHOnGPU ֱдԴ
+                if (bvhSettings.width > 2) {
+                    throw std::runtime_error("--bvh-width requires a CPU BVH builder");
+                }
+                bvhNodeCount = 2 * triangles.size() - 1;
+                bvhSettings.validate = bvhSettings.validate || bvhSettings.compare;
+                return;
+            }
+            bvhSettings.builder = BVHBuilderType::Binned;
+        }
+
+        BVHBuildStats stats = runBVHBuilder(bvhSettings.builder, BVHNodes);
+        bvhNodeCount = BVHNodes.size();
+        builtSAHCost = stats.sahCost;
+        printBVHStats(bvhSettings.builder, stats);
+
+        if (bvhSettings.width > 2) {
+            collapseBVH(bvhSettings.width);
+        }
+        reportTraversalDepth(bvhSettings.width > 2 ? computeWideBVHDepth(bvhSettings.width) : stats.depth, bvhSettings.width);
+        gatherTriangles();
+
+        if (bvhSettings.compare) {
+            // ڸһַڶԱȣӰϴ
+            BVHBuilderType other = bvhSettings.builder == BVHBuilderType::Binned ? BVHBuilderType::Sweep : BVHBuilderType::Binned;
+            std::vector<uint32_t> savedTriangles = triangles;
+            std::vector<BVHNode> otherNodes;
+            BVHBuildStats otherStats = runBVHBuilder(other, otherNodes);
+            printBVHStats(other, otherStats);
+            triangles = savedTriangles;
+        }
+    }
+
+    // ջͬʱĴʽڵ㣺ÿ width-1 չĽڵѹ width 󵯳һ
+    // ʱȷֻĹ߸߽ջ
+    void reportTraversalDepth(int depth, int width) {
+        if ((width - 1) * depth + 1 > TRAVERSAL_STACK_SIZE) {
+            std::cout << "BVH depth " << depth << " may overflow the traversal stack (" << TRAVERSAL_STACK_SIZE
+                << " entries), deep rays fall back to parent-pointer traversal" << std::endl;
+        }
+    }
+
+    // ÿֻһεײӽڵҶӵ±껻㵽ϲ BVHNodes/triangles 
+    void buildMeshBVHs() {
+        meshes.assign(MESH_COUNT, Mesh{});
+        meshes[MESH_MODEL].triangleCount = static_cast<uint32_t>(modelTriangleCount);
+        meshes[MESH_BOX].firstTriangle = static_cast<uint32_t>(modelTriangleCount);
+        meshes[MESH_BOX].triangleCount = static_cast<uint32_t>(indices.size() / 3 - modelTriangleCount);
+
+        std::vector<uint32_t> allTriangles;
+        std::vector<BVHNode> allNodes;
+        for (Mesh& mesh : meshes) {
+            if (mesh.triangleCount == 0) continue;
+            triangles.resize(mesh.triangleCount);
+            std::iota(triangles.begin(), triangles.end(), mesh.firstTriangle);
+
+            std::vector<BVHNode> nodes;
+            BVHBuildStats stats = runBVHBuilder(bvhSettings.builder, nodes);
+            printBVHStats(bvhSettings.builder, stats);
+            reportTraversalDepth(stats.depth, 2);
+
+            int nodeBase = static_cast<int>(allNodes.size());
+            int triangleBase = static_cast<int>(allTriangles.size());
+            for (BVHNode& node : nodes) {
+                if (node.n > 0) {
+                    node.index += triangleBase;
+                }
+                else {
+                    if (node.left > 0) node.left += nodeBase;
+                    if (node.right > 0) node.right += nodeBase;
+                }
+                if (node.parent >= 0) node.parent += nodeBase;
+            }
+            mesh.root = nodeBase;
+            mesh.AA = nodes[0].AA;
+            mesh.BB = nodes[0].BB;
+            allNodes.insert(allNodes.end(), nodes.begin(), nodes.end());
+            allTriangles.insert(allTriangles.end(), triangles.begin(), triangles.end());
+        }
+        triangles = std::move(allTriangles);
+        BVHNodes = std::move(allNodes);
+        bvhNodeCount = BVHNodes.size();
+        gatherTriangles();
+
+        createMeshInstances();
+        buildTLAS();
+        size_t modelInstances = meshInstances.size() - (meshes[MESH_BOX].root >= 0 ? 1 : 0);
+        std::cout << "instancing: " << meshInstances.size() << " instances (" << modelInstances << " x model), "
+            << triangles.size() << " unique triangles, " << bvhNodeCount << " BLAS nodes, " << tlasNodes.size() << " TLAS nodes; "
+            << "flattened scene would need " << modelInstances * meshes[MESH_MODEL].triangleCount + meshes[MESH_BOX].triangleCount
+            << " triangles" << std::endl;
+    }
+
+    // Cornell box һʵN ģʵںų k*k СΪ 1/kN Ϊ 1 ʱ뵥㳡һ
+    void createMeshInstances() {
+        meshInstances.clear();
+        if (meshes[MESH_BOX].root >= 0) {
+            meshInstances.push_back({ MESH_BOX, glm::mat4(1.0f), glm::mat4(1.0f) });
+        }
+        const Mesh& model = meshes[MESH_MODEL];
+        if (model.root < 0) return;
+        if (instanceCount == 1) {
+            meshInstances.push_back({ MESH_MODEL, glm::mat4(1.0f), glm::mat4(1.0f) });
+            return;
+        }
+
+        int k = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+        float cell = 2.0f / k;
+        // ģ͵Ϊ׼ź߶Ȳ
+        glm::vec3 base = glm::vec3((model.AA.x + model.BB.x) * 0.5f, model.AA.y, (model.AA.z + model.BB.z) * 0.5f);
+        for (int i = 0; i < instanceCount; i++) {
+            glm::vec3 center = glm::vec3(-1.0f + (i % k + 0.5f) * cell, base.y, -1.0f + (i / k + 0.5f) * cell);
+            glm::mat4 placement = glm::translate(glm::mat4(1.0f), center)
+                * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / k))
+                * glm::translate(glm::mat4(1.0f), -base);
+            meshInstances.push_back({ MESH_MODEL, placement, placement });
+        }
+    }
+
+    // ʵ٣λּɣÿҶһʵ
+    void buildTLAS() {
+        size_t count = meshInstances.size();
+        std::vector<glm::vec3> AA(count), BB(count);
+        for (size_t i = 0; i < count; i++) {
+            const MeshInstance& instance = meshInstances[i];
+            const Mesh& mesh = meshes[instance.mesh];
+            AA[i] = glm::vec3(std::numeric_limits<float>::max());
+            BB[i] = glm::vec3(-std::numeric_limits<float>::max());
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 p = glm::vec3(corner & 1 ? mesh.BB.x : mesh.AA.x, corner & 2 ? mesh.BB.y : mesh.AA.y, corner & 4 ? mesh.BB.z : mesh.AA.z);
+                glm::vec3 q = glm::vec3(instance.transform * glm::vec4(p, 1.0f));
+                AA[i] = glm::min(AA[i], q);
+                BB[i] = glm::max(BB[i], q);
+            }
+        }
+
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        tlasNodes.clear();
+        tlasNodes.reserve(2 * count);
+        if (count > 0) buildTLASNode(order, 0, count, AA, BB);
+    }
+
+    int buildTLASNode(std::vector<uint32_t>& order, size_t l, size_t r, const std::vector<glm::vec3>& AA, const std::vector<glm::vec3>& BB) {
+        int id = static_cast<int>(tlasNodes.size());
+        tlasNodes.push_back(BVHNode{});
+
+        BVHNode node{};
+        node.AA = glm::vec3(std::numeric_limits<float>::max());
+        node.BB = glm::vec3(-std::numeric_limits<float>::max());
+        glm::vec3 centroidMin = node.AA, centroidMax = node.BB;
+        for (size_t i = l; i < r; i++) {
+            uint32_t k = order[i];
+            node.AA = glm::min(node.AA, AA[k]);
+            node.BB = glm::max(node.BB, BB[k]);
+            glm::vec3 centroid = (AA[k] + BB[k]) * 0.5f;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+
+        if (r - l == 1) {
+            node.n = 1;
+            node.index = static_cast<int>(order[l]);
+        }
+        else {
+            glm::vec3 extent = centroidMax - centroidMin;
+            int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+            size_t mid = (l + r) / 2;
+            std::nth_element(order.begin() + l, order.begin() + mid, order.begin() + r,
+                [&](uint32_t a, uint32_t b) { return AA[a][axis] + BB[a][axis] < AA[b][axis] + BB[b][axis]; });
+            node.left = buildTLASNode(order, l, mid, AA, BB);
+            node.right = buildTLASNode(order, mid, r, AA, BB);
+        }
+        tlasNodes[id] = node;
+        return id;
+    }
+
+    TaskPool* getTaskPool() {
+        if (!taskPool) {
+            taskPool = std::make_unique<TaskPool>(threadCount);
+        }
+        return taskPool.get();
+    }
+
+    // ڵǰ vertices ųԱ triangles
+    BVHBuildStats runBVHBuilder(BVHBuilderType type, std::vector<BVHNode>& nodes) {
+        BVHBuildContext ctx{ vertices, triangles };
+        return runBVHBuilder(type, ctx, nodes);
+    }
+
+    BVHBuildStats runBVHBuilder(BVHBuilderType type, BVHBuildContext& ctx, std::vector<BVHNode>& nodes) {
+        nodes.clear();
+        // ̳߳صĴ뽨ʱ
+        TaskPool* pool = (type == BVHBuilderType::Binned && resolveThreadCount(threadCount) > 1) ? getTaskPool() : nullptr;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        int last = static_cast<int>(ctx.triangles.size()) - 1;
+        if (type == BVHBuilderType::Binned) {
+            prepareBVHPrimitives(ctx, pool);
+            if (pool) {
+                createBVHParallel(ctx, *pool, nodes, bvhSettings.leafSize);
+            }
+            else {
+                BVHBinScratch scratch;
+                resizeBinScratch(scratch);
+                createBVHBinned(ctx, nodes, 0, last, bvhSettings.leafSize, scratch);
+            }
+        }
+        else {
+            createBVH(ctx, nodes, 0, last, bvhSettings.leafSize);
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        linkBVHParents(nodes);
+
+        BVHBuildStats stats;
+        stats.nodeCount = nodes.size();
+        stats.threads = pool ? pool->size() : 1;
+        stats.buildMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        stats.sahCost = computeSAHCost(nodes);
+        stats.depth = computeBVHDepth(nodes);
+        return stats;
+    }
+
+    // ֻӽڵ±꣬ڵͳһڽ
+    static void linkBVHParents(std::vector<BVHNode>& nodes) {
+        for (BVHNode& node : nodes) node.parent = -1;
+        for (size_t id = 0; id < nodes.size(); id++) {
+            if (nodes[id].n > 0) continue;
+            if (nodes[id].left > 0) nodes[nodes[id].left].parent = static_cast<int>(id);
+            if (nodes[id].right > 0) nodes[nodes[id].right].parent = static_cast<int>(id);
+        }
+    }
+
+    void printBVHStats(BVHBuilderType type, const BVHBuildStats& stats) {
+        std::cout << "BVH (" << bvhBuilderName(type) << ", "
+            << stats.threads << (stats.threads == 1 ? " thread" : " threads") << "): "
+            << triangles.size() << " triangles, " << stats.nodeCount << " nodes, depth " << stats.depth
+            << ", build " << stats.buildMs << " ms, SAH cost " << stats.sahCost << std::endl;
+    }
+
+    void resizeBinScratch(BVHBinScratch& scratch) {
+        int maxBins = *std::max_element(bvhSettings.binCount.begin(), bvhSettings.binCount.end());
+        scratch.bins.resize(3 * maxBins);
+        scratch.rightCost.resize(maxBins);
+    }
+
+    // ԤȼÿεĺͰΧУʱپ vertices/indices Ѱַ
+    void prepareBVHPrimitives(BVHBuildContext& ctx, TaskPool* pool) {
+        size_t count = indices.size() / 3;
+        ctx.centroids.resize(count);
+        ctx.AA.resize(count);
+        ctx.BB.resize(count);
+
+        auto prepare = [this, &ctx](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                glm::vec3 p1 = ctx.vertices[indices[3 * t]].pos;
+                glm::vec3 p2 = ctx.vertices[indices[3 * t + 1]].pos;
+                glm::vec3 p3 = ctx.vertices[indices[3 * t + 2]].pos;
+                ctx.AA[t] = glm::min(p1, glm::min(p2, p3));
+                ctx.BB[t] = glm::max(p1, glm::max(p2, p3));
+                ctx.centroids[t] = (p1 + p2 + p3) / 3.0f;
+            }
+        };
+        if (pool) {
+            pool->parallelFor(count, BVH_PARALLEL_CHUNK, [&](size_t begin, size_t end, size_t) { prepare(begin, end); });
+        }
+        else {
+            prepare(0, count);
+        }
+    }
+
+    static float surfaceArea(const glm::vec3& AA, const glm::vec3& BB) {
+        glm::vec3 len = glm::max(BB - AA, glm::vec3(0.0f));
+        return 2.0f * (len.x * len.y + len.x * len.z + len.y * len.z);
+    }
+
+    static int binIndex(const BinnedSplit& split, float centroid, int binCount) {
+        int b = static_cast<int>((centroid - split.origin) * split.scale);
+        return std::clamp(b, 0, binCount - 1);
+    }
+
+    // [l, r] İΧԼĵİΧ
+    static void computeRangeBounds(const BVHBuildContext& ctx, int l, int r, BVHRangeBounds& bounds) {
+        for (int i = l; i <= r; ++i) {
+            uint32_t t = ctx.triangles[i];
+            bounds.AA = glm::min(bounds.AA, ctx.AA[t]);
+            bounds.BB = glm::max(bounds.BB, ctx.BB[t]);
+            bounds.cMin = glm::min(bounds.cMin, ctx.centroids[t]);
+            bounds.cMax = glm::max(bounds.cMax, ctx.centroids[t]);
+        }
+    }
+
+    static void computeRangeBounds(const BVHBuildContext& ctx, int l, int r, BVHRangeBounds& bounds, TaskPool* pool) {
+        size_t total = r - l + 1;
+        if (!pool || total <= BVH_PARALLEL_CHUNK) {
+            computeRangeBounds(ctx, l, r, bounds);
+            return;
+        }
+
+        // ֿΧٺϲmin/max ϲ˳޹أ߳Ӱ
+        std::vector<BVHRangeBounds> partial((total + BVH_PARALLEL_CHUNK - 1) / BVH_PARALLEL_CHUNK);
+        pool->parallelFor(total, BVH_PARALLEL_CHUNK, [&](size_t begin, size_t end, size_t chunk) {
+            computeRangeBounds(ctx, l + static_cast<int>(begin), l + static_cast<int>(end) - 1, partial[chunk]);
+            });
+        for (const BVHRangeBounds& p : partial) {
+            bounds.AA = glm::min(bounds.AA, p.AA);
+            bounds.BB = glm::max(bounds.BB, p.BB);
+            bounds.cMin = glm::min(bounds.cMin, p.cMin);
+            bounds.cMax = glm::max(bounds.cMax, p.cMax);
+        }
+    }
+
+    // ÿķͰûпʱ binCounts Ϊ 0
+    void setupBinnedSplits(int total, const BVHRangeBounds& bounds, std::array<BinnedSplit, 3>& splits, std::array<int, 3>& binCounts) {
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = bounds.cMax[axis] - bounds.cMin[axis];
+            // Ͱ
+            binCounts[axis] = extent > 0.0f ? std::min(bvhSettings.binCount[axis], total) : 0;
+            splits[axis].axis = axis;
+            splits[axis].origin = bounds.cMin[axis];
+            splits[axis].scale = extent > 0.0f ? binCounts[axis] * (1.0f - 1e-5f) / extent : 0.0f;
+        }
+    }
+
+    static void clearBins(BVHBin* bins, int count) {
+        for (int b = 0; b < count; b++) {
+            bins[b].AA = glm::vec3(INFINITY);
+            bins[b].BB = glm::vec3(-INFINITY);
+            bins[b].count = 0;
+        }
+    }
+
+    // һαͬʱΪͰbins δţÿռ stride 
+    static void binTriangles(const BVHBuildContext& ctx, int l, int r, const std::array<BinnedSplit, 3>& splits, const std::array<int, 3>& binCounts, BVHBin* bins, int stride) {
+        for (int axis = 0; axis < 3; ++axis) {
+            clearBins(bins + axis * stride, binCounts[axis]);
+        }
+        for (int i = l; i <= r; i++) {
+            uint32_t t = ctx.triangles[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                if (binCounts[axis] == 0) continue;
+                BVHBin& bin = bins[axis * stride + binIndex(splits[axis], ctx.centroids[t][axis], binCounts[axis])];
+                bin.AA = glm::min(bin.AA, ctx.AA[t]);
+                bin.BB = glm::max(bin.BB, ctx.BB[t]);
+                bin.count++;
+            }
+        }
+    }
+
+    // ɨһϵͰ SAH Сķָ
+    bool evaluateBins(const BinnedSplit& split, const BVHBin* bins, int binCount, int total, float* rightCost, BinnedSplit& best) {
+        bool found = false;
+
+        // ׺rightCost[b] Ϊָ b  b+1 ֮ʱҲĴ
+        glm::vec3 rightAA(INFINITY), rightBB(-INFINITY);
+        int rightCount = 0;
+        for (int b = binCount - 1; b > 0; b--) {
+            rightAA = glm::min(rightAA, bins[b].AA);
+            rightBB = glm::max(rightBB, bins[b].BB);
+            rightCount += bins[b].count;
+            rightCost[b - 1] = rightCount > 0 ? surfaceArea(rightAA, rightBB) * rightCount : 0.0f;
+        }
+
+        // ǰ׺ɨָ
+        glm::vec3 leftAA(INFINITY), leftBB(-INFINITY);
+        int leftCount = 0;
+        for (int b = 0; b < binCount - 1; b++) {
+            leftAA = glm::min(leftAA, bins[b].AA);
+            leftBB = glm::max(leftBB, bins[b].BB);
+            leftCount += bins[b].count;
+            if (leftCount == 0 || leftCount == total) continue;
+
+            float cost = surfaceArea(leftAA, leftBB) * leftCount + rightCost[b];
+            if (cost < best.cost) {
+                best = split;
+                best.bin = b;
+                best.cost = cost;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    //  [l, r] ϰķͰ SAH Сķָ
+    bool findBinnedSplit(const BVHBuildContext& ctx, int l, int r, const BVHRangeBounds& bounds, BVHBinScratch& scratch, BinnedSplit& best, TaskPool* pool) {
+        int total = r - l + 1;
+        int stride = static_cast<int>(scratch.rightCost.size());
+        std::array<BinnedSplit, 3> splits;
+        std::array<int, 3> binCounts;
+        setupBinnedSplits(total, bounds, splits, binCounts);
+
+        size_t count = static_cast<size_t>(total);
+        if (pool && count > BVH_PARALLEL_CHUNK) {
+            // ÿԷͰ󰴿˳ϲͰ߳޹
+            size_t chunks = (count + BVH_PARALLEL_CHUNK - 1) / BVH_PARALLEL_CHUNK;
+            std::vector<BVHBin> partial(chunks * 3 * stride);
+            pool->parallelFor(count, BVH_PARALLEL_CHUNK, [&](size_t begin, size_t end, size_t chunk) {
+                binTriangles(ctx, l + static_cast<int>(begin), l + static_cast<int>(end) - 1, splits, binCounts, &partial[chunk * 3 * stride], stride);
+                });
+            for (int axis = 0; axis < 3; ++axis) {
+                clearBins(&scratch.bins[axis * stride], binCounts[axis]);
+            }
+            for (size_t chunk = 0; chunk < chunks; chunk++) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    for (int b = 0; b < binCounts[axis]; b++) {
+                        BVHBin& dst = scratch.bins[axis * stride + b];
+                        const BVHBin& src = partial[chunk * 3 * stride + axis * stride + b];
+                        dst.AA = glm::min(dst.AA, src.AA);
+                        dst.BB = glm::max(dst.BB, src.BB);
+                        dst.count += src.count;
+                    }
+                }
+            }
+        }
+        else {
+            binTriangles(ctx, l, r, splits, binCounts, scratch.bins.data(), stride);
+        }
+
+        bool found = false;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (binCounts[axis] < 2) continue;
+            found |= evaluateBins(splits[axis], &scratch.bins[axis * stride], binCounts[axis], total, scratch.rightCost.data(), best);
+        }
+        return found;
+    }
+
+    //  [l, r]벿ֵһ±
+    int splitBVHRange(BVHBuildContext& ctx, int l, int r, const BVHRangeBounds& bounds, BVHBinScratch& scratch, TaskPool* pool) {
+        std::vector<uint32_t>& triangles = ctx.triangles;
+        int mid = -1;
+        BinnedSplit split;
+        if (findBinnedSplit(ctx, l, r, bounds, scratch, split, pool)) {
+            int binCount = std::min(bvhSettings.binCount[split.axis], r - l + 1);
+            auto it = std::partition(triangles.begin() + l, triangles.begin() + r + 1, [&](uint32_t t) {
+                return binIndex(split, ctx.centroids[t][split.axis], binCount) <= split.bin;
+                });
+            mid = static_cast<int>(it - triangles.begin()) - 1;
+        }
+        // ȫغϻͬһͰᰴλ԰
+        if (mid < l || mid >= r) {
+            glm::vec3 extent = bounds.cMax - bounds.cMin;
+            int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+            mid = (l + r) / 2;
+            std::nth_element(triangles.begin() + l, triangles.begin() + mid, triangles.begin() + r + 1, [&](uint32_t t1, uint32_t t2) {
+                return ctx.centroids[t1][axis] < ctx.centroids[t2][axis];
+                });
+        }
+        return mid;
+    }
+
+    int createBVHBinned(BVHBuildContext& ctx, std::vector<BVHNode>& nodes, int l, int r, int n, BVHBinScratch& scratch) {
+        if (l > r) return 0;
+        nodes.push_back(BVHNode());
+        int id = nodes.size() - 1;
+        nodes[id].left = nodes[id].right = nodes[id].n = nodes[id].index = 0;
+
+        BVHRangeBounds bounds;
+        computeRangeBounds(ctx, l, r, bounds);
+        nodes[id].AA = bounds.AA;
+        nodes[id].BB = bounds.BB;
+
+        //  n  Ҷӽڵ
+        if ((r - l + 1) <= n) {
+            nodes[id].n = r - l + 1;
+            nodes[id].index = l;
+            return id;
+        }
+
+        int mid = splitBVHRange(ctx, l, r, bounds, scratch, nullptr);
+
+        // ݹ
+        int left = createBVHBinned(ctx, nodes, l, mid, n, scratch);
+        int right = createBVHBinned(ctx, nodes, mid + 1, r, n, scratch);
+
+        nodes[id].left = left;
+        nodes[id].right = right;
+
+        return id;
+    }
+
+    // нС BVH_PARALLEL_SUBTREE һﴮн
+    void createBVHSubtree(BVHBuildContext& ctx, TaskPool& pool, TaskGroup& group, BVHSubtree& subtree, int n) {
+        int l = subtree.l, r = subtree.r;
+        if (r - l + 1 <= std::max(BVH_PARALLEL_SUBTREE, n)) {
+            BVHBinScratch scratch;
+            resizeBinScratch(scratch);
+            createBVHBinned(ctx, subtree.nodes, l, r, n, scratch);
+            return;
+        }
+
+        BVHRangeBounds bounds;
+        computeRangeBounds(ctx, l, r, bounds, &pool);
+        subtree.node.left = subtree.node.right = subtree.node.n = subtree.node.index = 0;
+        subtree.node.AA = bounds.AA;
+        subtree.node.BB = bounds.BB;
+
+        BVHBinScratch scratch;
+        resizeBinScratch(scratch);
+        int mid = splitBVHRange(ctx, l, r, bounds, scratch, &pool);
+
+        subtree.left = std::make_unique<BVHSubtree>();
+        subtree.left->l = l;
+        subtree.left->r = mid;
+        subtree.right = std::make_unique<BVHSubtree>();
+        subtree.right->l = mid + 1;
+        subtree.right->r = r;
+
+        BVHSubtree* left = subtree.left.get();
+        BVHSubtree* right = subtree.right.get();
+        pool.spawn(group, [this, &ctx, &pool, &group, left, n]() { createBVHSubtree(ctx, pool, group, *left, n); });
+        pool.spawn(group, [this, &ctx, &pool, &group, right, n]() { createBVHSubtree(ctx, pool, group, *right, n); });
+    }
+
+    // ѸĽڵƴӳһ飬봮нĽڵ˳ȫһ
+    int compactBVHSubtree(const BVHSubtree& subtree, std::vector<BVHNode>& nodes) {
+        if (!subtree.left) {
+            int offset = static_cast<int>(nodes.size());
+            for (BVHNode node : subtree.nodes) {
+                if (node.n == 0) {
+                    node.left += offset;
+                    node.right += offset;
+                }
+                nodes.push_back(node);
+            }
+            return offset;
+        }
+
+        int id = static_cast<int>(nodes.size());
+        nodes.push_back(subtree.node);
+        int left = compactBVHSubtree(*subtree.left, nodes);
+        int right = compactBVHSubtree(*subtree.right, nodes);
+        nodes[id].left = left;
+        nodes[id].right = right;
+        return id;
+    }
+
+    void createBVHParallel(BVHBuildContext& ctx, TaskPool& pool, std::vector<BVHNode>& nodes, int n) {
+        if (ctx.triangles.empty()) return;
+
+        BVHSubtree root;
+        root.l = 0;
+        root.r = static_cast<int>(ctx.triangles.size()) - 1;
+
+        TaskGroup group;
+        pool.spawn(group, [this, &ctx, &pool, &group, &root, n]() { createBVHSubtree(ctx, pool, group, root, n); });
+        pool.wait(group);
+
+        nodes.reserve(2 * ctx.triangles.size());
+        compactBVHSubtree(root, nodes);
+    }
+
+    // Ըڵһ SAH 
+    float computeSAHCost(const std::vector<BVHNode>& nodes) {
+        if (nodes.empty()) return 0.0f;
+        float rootArea = surfaceArea(nodes[0].AA, nodes[0].BB);
+        if (rootArea <= 0.0f) return 0.0f;
+
+        float cost = 0.0f;
+        for (const BVHNode& node : nodes) {
+            float area = surfaceArea(node.AA, node.BB) / rootArea;
+            if (node.n > 0) cost += area * node.n * SAH_INTERSECTION_COST;
+            else cost += area * SAH_TRAVERSAL_COST;
+        }
+        return cost;
+    }
+
+    int computeBVHDepth(const std::vector<BVHNode>& nodes) {
+        if (nodes.empty()) return 0;
+        int depth = 0;
+        std::vector<std::pair<int, int>> stack = { { 0, 1 } };
+        while (!stack.empty()) {
+            auto [id, d] = stack.back();
+            stack.pop_back();
+            depth = std::max(depth, d);
+            // صлʱȻᳬڵֱӷȼʧ
+            if (d > static_cast<int>(nodes.size())) return d;
+            if (nodes[id].n > 0) continue;
+            if (nodes[id].left > 0) stack.push_back({ nodes[id].left, d + 1 });
+            if (nodes[id].right > 0) stack.push_back({ nodes[id].right, d + 1 });
+        }
+        return depth;
+    }
+
+    // Ѷ۵ width չڲӽڵ㣬ֱӽڵﵽ width
+    void collapseBVH(int width) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        wideBVHNodes.clear();
+        collapseBVHNode(0, width);
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        size_t nodeCount = wideBVHNodes.size() / width;
+        size_t used = std::count_if(wideBVHNodes.begin(), wideBVHNodes.end(), [](const WideBVHChild& c) { return c.count >= 0; });
+        std::cout << "BVH" << width << ": " << nodeCount << " nodes, " << (double)used / nodeCount << " children per node, depth "
+            << computeWideBVHDepth(width) << ", collapse " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+    }
+
+    int collapseBVHNode(int id, int width) {
+        int wideId = static_cast<int>(wideBVHNodes.size() / width);
+        WideBVHChild empty{ glm::vec3(0.0f), 0, glm::vec3(0.0f), -1 };
+        wideBVHNodes.resize(wideBVHNodes.size() + width, empty);
+
+        std::array<int, MAX_BVH_WIDTH> children{};
+        int childCount = 0;
+        if (BVHNodes[id].n > 0) {
+            children[childCount++] = id;    // ֻһҶ
+        }
+        else {
+            if (BVHNodes[id].left > 0) children[childCount++] = BVHNodes[id].left;
+            if (BVHNodes[id].right > 0) children[childCount++] = BVHNodes[id].right;
+        }
+
+        while (childCount < width) {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (int i = 0; i < childCount; i++) {
+                const BVHNode& node = BVHNodes[children[i]];
+                float area = surfaceArea(node.AA, node.BB);
+                if (node.n == 0 && area > bestArea) {
+                    best = i;
+                    bestArea = area;
+                }
+            }
+            if (best < 0) break;
+
+            const BVHNode& node = BVHNodes[children[best]];
+            children[best] = node.left;
+            children[childCount++] = node.right;
+        }
+
+        for (int i = 0; i < childCount; i++) {
+            const BVHNode& node = BVHNodes[children[i]];
+            WideBVHChild child{ node.AA, node.index, node.BB, node.n };
+            if (node.n == 0) {
+                child.child = collapseBVHNode(children[i], width);
+            }
+            // ݹ wideBVHNodesǰȡ
+            wideBVHNodes[wideId * width + i] = child;
+        }
+        return wideId;
+    }
+
+    int computeWideBVHDepth(int width) {
+        if (wideBVHNodes.empty()) return 0;
+        int depth = 0;
+        std::vector<std::pair<int, int>> stack = { { 0, 1 } };
+        while (!stack.empty()) {
+            auto [id, d] = stack.back();
+            stack.pop_back();
+            depth = std::max(depth, d);
+            for (int i = 0; i < width; i++) {
+                const WideBVHChild& child = wideBVHNodes[id * width + i];
+                if (child.count == 0) stack.push_back({ child.child, d + 1 });
+            }
+        }
+        return depth;
+    }
+
+    //  triangles Ҷ˳дõλ/ߺɫԣʱپ triangles -> indices -> vertices
+    void gatherTriangles() {
+        gatherTriangles(vertices, triangles, trianglePositions, triangleShading);
+    }
+
+    void gatherTriangles(const std::vector<Vertex>& verts, const std::vector<uint32_t>& order,
+        std::vector<TrianglePositions>& positions, std::vector<TriangleShading>& shading) {
+        size_t count = order.size();
+        positions.resize(count);
+        shading.resize(count);
+
+        auto gather = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t t = order[i];
+                const Vertex& v0 = verts[indices[3 * t]];
+                const Vertex& v1 = verts[indices[3 * t + 1]];
+                const Vertex& v2 = verts[indices[3 * t + 2]];
+                positions[i] = { v0.pos, v1.pos, v2.pos };
+                // ԭ getTriangle ȡһ£ɫԷȡһ㣬ֲڶȡ
+                shading[i] = { v0.color, v2.roughness, v0.emissive ? 1u : 0u, t };
+            }
+        };
+        if (count >= BVH_PARALLEL_CHUNK && resolveThreadCount(threadCount) > 1) {
+            getTaskPool()->parallelFor(count, BVH_PARALLEL_CHUNK, [&](size_t begin, size_t end, size_t) { gather(begin, end); });
+        }
+        else {
+            gather(0, count);
+        }
+    }
+
+    // üɫֱд resourceBuffer ζκͽڵ
+    // ڲڵ [0, n-1)Ϊ 0Ҷ [n-1, 2n-1) shader.frag ıԼһ
+    void buildBVHOnGPU() {
+        uint32_t n = static_cast<uint32_t>(triangles.size());
+        GPUBVHBuilder builder;
+        createGPUBVHBuilder(builder, n);
+
+        BVHBuilderType type = bvhSettings.builder;
+        int iterations = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        BVHBuildConstants constants{};
+        constants.leafCount = n;
+        constants.count = n;
+        uint32_t groups = groupsFor(n, BUILD_WORKGROUP_SIZE);
+
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipelineLayout, 0, 1, &builder.descriptorSet, 0, nullptr);
+        vkCmdFillBuffer(commandBuffer, builder.buffers[GPU_BVH_FLAGS], 0, VK_WHOLE_SIZE, 0);
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        dispatchBuildPass(commandBuffer, builder, GPU_BVH_SCENE_BOUNDS, constants, groups);
+        computeBarrier(commandBuffer);
+        dispatchBuildPass(commandBuffer, builder, GPU_BVH_MORTON, constants, groups);
+        computeBarrier(commandBuffer);
+        recordRadixSort(commandBuffer, builder, n);
+        dispatchBuildPass(commandBuffer, builder, GPU_BVH_LEAVES, constants, groups);
+        computeBarrier(commandBuffer);
+
+        if (type == BVHBuilderType::LBVH) {
+            constants.count = n - 1;
+            dispatchBuildPass(commandBuffer, builder, GPU_BVH_HIERARCHY, constants, groupsFor(n - 1, BUILD_WORKGROUP_SIZE));
+            computeBarrier(commandBuffer);
+            constants.count = n;
+            dispatchBuildPass(commandBuffer, builder, GPU_BVH_REFIT, constants, groups);
+        }
+        endSingleTimeCommands(commandBuffer);
 
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageOffset = { 0, 0, 0 };
-        region.imageExtent = {
-            width,
-            height,
-            1
+        if (type == BVHBuilderType::PLOC) {
+            // ÿֶҪʣǷ
+            uint32_t clusterCount = n;
+            while (clusterCount > 1) {
+                commandBuffer = beginSingleTimeCommands();
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipelineLayout, 0, 1, &builder.descriptorSet, 0, nullptr);
+
+                constants.count = clusterCount;
+                constants.radius = static_cast<uint32_t>(bvhSettings.plocRadius);
+                constants.scanOffset = 0;
+                uint32_t clusterGroups = groupsFor(clusterCount, BUILD_WORKGROUP_SIZE);
+                dispatchBuildPass(commandBuffer, builder, GPU_BVH_PLOC_NEAREST, constants, clusterGroups);
+                computeBarrier(commandBuffer);
+                dispatchBuildPass(commandBuffer, builder, GPU_BVH_PLOC_MERGE, constants, clusterGroups);
+                computeBarrier(commandBuffer);
+                recordScan(commandBuffer, builder, 0, clusterCount, builder.scanSumsOffset);
+                computeBarrier(commandBuffer);
+                dispatchBuildPass(commandBuffer, builder, GPU_BVH_PLOC_COMPACT, constants, clusterGroups);
+                memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+                endSingleTimeCommands(commandBuffer);
+
+                uint32_t remaining = builder.globals->clusterCount;
+                if (remaining >= clusterCount) {
+                    throw std::runtime_error("PLOC made no progress!");
+                }
+                clusterCount = remaining;
+                iterations++;
+            }
+            if (builder.globals->allocated != n - 1) {
+                throw std::runtime_error("PLOC allocated an unexpected number of nodes!");
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << "BVH (" << bvhBuilderName(type) << "): " << n << " triangles, " << bvhNodeCount << " nodes, build "
+            << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms";
+        if (type == BVHBuilderType::PLOC) {
+            std::cout << ", " << iterations << " iterations (radius " << bvhSettings.plocRadius << ")";
+        }
+        std::cout << std::endl;
+
+        destroyGPUBVHBuilder(builder);
+
+        if (bvhSettings.validate) {
+            validateGPUBVH();
+        }
+    }
+
+    void createGPUBVHBuilder(GPUBVHBuilder& builder, uint32_t n) {
+        std::array<VkDescriptorSetLayoutBinding, 6 + GPU_BVH_BUFFER_COUNT> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &builder.setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create BVH build descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(BVHBuildConstants);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &builder.setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &builder.pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create BVH build pipeline layout!");
+        }
+
+        for (int pass = 0; pass < GPU_BVH_PASS_COUNT; pass++) {
+            builder.pipelines[pass] = createComputePipeline(GPU_BVH_SHADERS[pass], builder.pipelineLayout);
+        }
+
+        // ǰ׺ͻ壺ݶ֮δŸ
+        bool ploc = bvhSettings.builder == BVHBuilderType::PLOC;
+        uint32_t scanCount = std::max(n, RADIX_SIZE * groupsFor(n, RADIX_TILE_SIZE));
+        builder.scanSumsOffset = scanCount;
+        for (uint32_t level = scanCount; level > 1; ) {
+            level = groupsFor(level, SCAN_BLOCK_SIZE);
+            scanCount += level;
+        }
+
+        std::array<VkDeviceSize, GPU_BVH_BUFFER_COUNT> sizes{};
+        sizes[GPU_BVH_KEYS] = sizeof(uint32_t) * 2 * n;
+        sizes[GPU_BVH_VALUES] = sizeof(uint32_t) * 2 * n;
+        sizes[GPU_BVH_SCAN] = sizeof(uint32_t) * (scanCount + 1);
+        sizes[GPU_BVH_PARENTS] = ploc ? 0 : sizeof(int) * (2 * n - 1);
+        sizes[GPU_BVH_FLAGS] = sizeof(uint32_t) * n;
+        sizes[GPU_BVH_CLUSTERS] = sizeof(int) * 2 * n;
+        sizes[GPU_BVH_NEIGHBOURS] = ploc ? sizeof(int) * n : 0;
+        sizes[GPU_BVH_GLOBALS] = sizeof(BVHBuildGlobals);
+        for (int i = 0; i < GPU_BVH_BUFFER_COUNT; i++) {
+            // ǰòĻҲҪ󶨣һСռλ
+            VkDeviceSize size = std::max<VkDeviceSize>(sizes[i], 16);
+            if (i == GPU_BVH_GLOBALS) {
+                createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, builder.buffers[i], builder.memories[i]);
+            }
+            else {
+                createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.buffers[i], builder.memories[i]);
+            }
+        }
+
+        builder.globals = reinterpret_cast<BVHBuildGlobals*>(builder.memories[GPU_BVH_GLOBALS].mapped);
+        for (int axis = 0; axis < 3; axis++) {
+            builder.globals->sceneMin[axis] = 0xFFFFFFFFu;
+            builder.globals->sceneMax[axis] = 0;
+        }
+        builder.globals->allocated = 0;
+        builder.globals->clusterCount = n;
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &builder.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create BVH build descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = builder.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &builder.setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &builder.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate BVH build descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 6 + GPU_BVH_BUFFER_COUNT> bufferInfos{};
+        bufferInfos[0] = resourceBufferInfo(resourceLayout.vertices);
+        bufferInfos[1] = resourceBufferInfo(resourceLayout.indices);
+        bufferInfos[2] = resourceBufferInfo(resourceLayout.triangles);
+        bufferInfos[3] = resourceBufferInfo(resourceLayout.BVHNodes);
+        for (int i = 0; i < GPU_BVH_BUFFER_COUNT; i++) {
+            bufferInfos[4 + i].buffer = builder.buffers[i];
+            bufferInfos[4 + i].offset = 0;
+            bufferInfos[4 + i].range = VK_WHOLE_SIZE;
+        }
+        bufferInfos[4 + GPU_BVH_BUFFER_COUNT] = resourceBufferInfo(resourceLayout.trianglePositions);
+        bufferInfos[5 + GPU_BVH_BUFFER_COUNT] = resourceBufferInfo(resourceLayout.triangleShading);
+        std::array<VkWriteDescriptorSet, 6 + GPU_BVH_BUFFER_COUNT> descriptorWrites{};
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = builder.descriptorSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    void destroyGPUBVHBuilder(GPUBVHBuilder& builder) {
+        for (int i = 0; i < GPU_BVH_BUFFER_COUNT; i++) {
+            destroyBuffer(builder.buffers[i], builder.memories[i]);
+        }
+        for (VkPipeline pipeline : builder.pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        vkDestroyDescriptorPool(device, builder.descriptorPool, nullptr);
+        vkDestroyPipelineLayout(device, builder.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, builder.setLayout, nullptr);
+        builder = GPUBVHBuilder{};
+    }
+
+    // 8  4 λ򣬼ֵ keys/values ǰ֮أż˺صǰ
+    void recordRadixSort(VkCommandBuffer commandBuffer, const GPUBVHBuilder& builder, uint32_t n) {
+        uint32_t tiles = groupsFor(n, RADIX_TILE_SIZE);
+        BVHBuildConstants constants{};
+        constants.count = n;
+        constants.leafCount = n;
+        for (uint32_t shift = 0; shift < 32; shift += RADIX_BITS) {
+            bool odd = (shift / RADIX_BITS) % 2 == 1;
+            constants.shift = shift;
+            constants.srcOffset = odd ? n : 0;
+            constants.dstOffset = odd ? 0 : n;
+            constants.scanOffset = 0;
+            dispatchBuildPass(commandBuffer, builder, GPU_BVH_RADIX_HISTOGRAM, constants, tiles);
+            computeBarrier(commandBuffer);
+            recordScan(commandBuffer, builder, 0, RADIX_SIZE * tiles, builder.scanSumsOffset);
+            computeBarrier(commandBuffer);
+            dispatchBuildPass(commandBuffer, builder, GPU_BVH_RADIX_SCATTER, constants, tiles);
+            computeBarrier(commandBuffer);
+        }
+    }
+
+    //  scan[offset, offset + count) ǰ׺ͣʹ sumsOffset ţһʱݹ
+    void recordScan(VkCommandBuffer commandBuffer, const GPUBVHBuilder& builder, uint32_t offset, uint32_t count, uint32_t sumsOffset) {
+        uint32_t blocks = groupsFor(count, SCAN_BLOCK_SIZE);
+        BVHBuildConstants constants{};
+        constants.count = count;
+        constants.scanOffset = offset;
+        constants.sumsOffset = sumsOffset;
+        dispatchBuildPass(commandBuffer, builder, GPU_BVH_SCAN_BLOCK, constants, blocks);
+        if (blocks > 1) {
+            computeBarrier(commandBuffer);
+            recordScan(commandBuffer, builder, sumsOffset, blocks, sumsOffset + blocks);
+            computeBarrier(commandBuffer);
+            dispatchBuildPass(commandBuffer, builder, GPU_BVH_SCAN_ADD, constants, blocks);
+        }
+    }
+
+    //  maxComputeWorkGroupCount  65535 ʱɶά
+    void dispatchBuildPass(VkCommandBuffer commandBuffer, const GPUBVHBuilder& builder, GPUBVHPass pass, BVHBuildConstants constants, uint32_t groups) {
+        if (groups == 0) return;
+        constants.groupCount = groups;
+        uint32_t x = std::min(groups, MAX_DISPATCH_GROUPS);
+        uint32_t y = groupsFor(groups, x);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipelines[pass]);
+        vkCmdPushConstants(commandBuffer, builder.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BVHBuildConstants), &constants);
+        vkCmdDispatch(commandBuffer, x, y, 1);
+    }
+
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    static void computeBarrier(VkCommandBuffer commandBuffer) {
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    VkPipeline createComputePipeline(const std::string& filename, VkPipelineLayout layout, const VkSpecializationInfo* specialization = nullptr) {
+        auto shaderCode = readFile(filename);
+        VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = specialization;
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline: " + filename);
+        }
+        recordPipelineTime(startTime);
+
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+        return pipeline;
+    }
+
+    void readBackResource(const BufferRegion& region, void* dst) {
+        VkBuffer stagingBuffer;
+        Allocation stagingBufferMemory;
+        createBuffer(region.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryUsage::Transient);
+        copyBuffer(resourceBuffer, stagingBuffer, region.size, region.offset, 0);
+
+        memcpy(dst, stagingBufferMemory.mapped, (size_t)region.size);
+        destroyBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    //  GPU õṹ飬 CPU Ͱ SAH Ƚ
+    void validateGPUBVH() {
+        size_t n = triangles.size();
+        std::vector<uint32_t> gpuTriangles(n);
+        std::vector<BVHNode> gpuNodes(bvhNodeCount);
+        readBackResource(resourceLayout.triangles, gpuTriangles.data());
+        readBackResource(resourceLayout.BVHNodes, gpuNodes.data());
+
+        size_t errors = 0;
+        auto fail = [&errors](const std::string& message) {
+            if (errors++ < 10) std::cerr << "GPU BVH: " << message << std::endl;
         };
+        auto contains = [](const glm::vec3& AA, const glm::vec3& BB, const glm::vec3& a, const glm::vec3& b) {
+            return AA.x <= a.x && AA.y <= a.y && AA.z <= a.z && b.x <= BB.x && b.y <= BB.y && b.z <= BB.z;
+        };
+
+        // һУÿڵֻܴӸһΣÿֻܱһҶӸ
+        std::vector<char> usedTriangle(n, 0);
+        for (uint32_t t : gpuTriangles) {
+            if (t >= n || usedTriangle[t]++) fail("triangle array is not a permutation (" + std::to_string(t) + ")");
+        }
+
+        std::vector<char> visited(gpuNodes.size(), 0);
+        std::vector<char> covered(n, 0);
+        std::vector<int> stack = { 0 };
+        if (gpuNodes[0].parent != -1) fail("root has parent " + std::to_string(gpuNodes[0].parent));
+        while (!stack.empty()) {
+            int id = stack.back();
+            stack.pop_back();
+            if (visited[id]++) {
+                fail("node " + std::to_string(id) + " is reachable twice");
+                continue;
+            }
+            const BVHNode& node = gpuNodes[id];
+            if (node.n > 0) {
+                for (int k = node.index; k < node.index + node.n; k++) {
+                    if (k < 0 || k >= static_cast<int>(n) || covered[k]++) {
+                        fail("leaf " + std::to_string(id) + " has a bad triangle range");
+                        continue;
+                    }
+                    uint32_t t = gpuTriangles[k];
+                    if (t >= n) continue;
+                    glm::vec3 p0 = vertices[indices[3 * t]].pos;
+                    glm::vec3 p1 = vertices[indices[3 * t + 1]].pos;
+                    glm::vec3 p2 = vertices[indices[3 * t + 2]].pos;
+                    if (!contains(node.AA, node.BB, glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)))) {
+                        fail("leaf " + std::to_string(id) + " does not bound its triangle");
+                    }
+                }
+                continue;
+            }
+            for (int child : { node.left, node.right }) {
+                if (child <= 0 || child >= static_cast<int>(gpuNodes.size())) {
+                    fail("node " + std::to_string(id) + " has a bad child " + std::to_string(child));
+                    continue;
+                }
+                if (!contains(node.AA, node.BB, gpuNodes[child].AA, gpuNodes[child].BB)) {
+                    fail("node " + std::to_string(id) + " does not bound child " + std::to_string(child));
+                }
+                if (gpuNodes[child].parent != id) {
+                    fail("node " + std::to_string(child) + " has parent " + std::to_string(gpuNodes[child].parent) + ", expected " + std::to_string(id));
+                }
+                stack.push_back(child);
+            }
+        }
+        if (std::count(visited.begin(), visited.end(), 0) > 0) fail("some nodes are unreachable from the root");
+        if (std::count(covered.begin(), covered.end(), 0) > 0) fail("some triangles are not covered by a leaf");
+
+        // CPU  trianglesڸϽ
+        std::vector<uint32_t> savedTriangles = triangles;
+        std::vector<BVHNode> cpuNodes;
+        BVHBuildStats cpuStats = runBVHBuilder(BVHBuilderType::Binned, cpuNodes);
+        printBVHStats(BVHBuilderType::Binned, cpuStats);
+        triangles = savedTriangles;
+
+        if (!contains(gpuNodes[0].AA, gpuNodes[0].BB, cpuNodes[0].AA, cpuNodes[0].BB) || !contains(cpuNodes[0].AA, cpuNodes[0].BB, gpuNodes[0].AA, gpuNodes[0].BB)) {
+            fail("root bounds differ from the CPU tree");
+        }
 
-        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        std::cout << "GPU BVH validation: " << (errors == 0 ? "passed" : "FAILED") << ", depth " << computeBVHDepth(gpuNodes)
+            << ", SAH cost " << computeSAHCost(gpuNodes) << " (CPU binned SAH " << cpuStats.sahCost << ")" << std::endl;
+        if (errors > 0) {
+            throw std::runtime_error("GPU BVH validation failed with " + std::to_string(errors) + " errors!");
+        }
 
-        endSingleTimeCommands(commandBuffer);
+        // УͨһԴһµĸ
+        triangles = std::move(gpuTriangles);
+        BVHNodes = std::move(gpuNodes);
     }
 
-    void loadModel() {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
+    void createDynamicRefit() {
+        DynamicRefit& refit = dynamicRefit;
 
-        Vertex vertex{};
-        vertex.pos = { -1,1,0.5 }; screenVertices.push_back(vertex);
-        vertex.pos = { 1,1,0.5 }; screenVertices.push_back(vertex);
-        vertex.pos = { 1,-1,0.5 }; screenVertices.push_back(vertex);
-        vertex.pos = { -1,-1,0.5 }; screenVertices.push_back(vertex);
+        // תᴩģײе
+        glm::vec3 AA(std::numeric_limits<float>::max());
+        glm::vec3 BB(-std::numeric_limits<float>::max());
+        for (size_t i = 0; i < modelVertexCount; i++) {
+            AA = glm::min(AA, vertices[i].pos);
+            BB = glm::max(BB, vertices[i].pos);
+        }
+        modelPivot = modelVertexCount > 0 ? (AA + BB) * 0.5f : glm::vec3(0.0f);
+
+        std::array<VkDescriptorSetLayoutBinding, 8> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &refit.setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create refit descriptor set layout!");
+        }
 
-        screenIndices = { 0,1,2,0,2,3 };
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(RefitConstants);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &refit.setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &refit.pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create refit pipeline layout!");
+        }
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-            throw std::runtime_error(warn + err);
+        for (int pass = 0; pass < REFIT_PASS_COUNT; pass++) {
+            refit.pipelines[pass] = createComputePipeline(REFIT_SHADERS[pass], refit.pipelineLayout);
         }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+        //  resourceBuffer  BVHNodes һڵ޷䣬ؽԭظ
+        VkDeviceSize offset = 0;
+        auto place = [&](BufferRegion& region, VkDeviceSize size) {
+            region.offset = offset;
+            region.size = std::max<VkDeviceSize>(size, 16);
+            offset = alignUp(offset + region.size, RESOURCE_ALIGNMENT);
+        };
+        place(refit.layout.parents, sizeof(int) * sceneCounts.BVHNodes);
+        place(refit.layout.leaves, sizeof(int) * sceneCounts.triangles);
+        place(refit.layout.flagInit, sizeof(uint32_t) * sceneCounts.BVHNodes);
+        place(refit.layout.flags, sizeof(uint32_t) * sceneCounts.BVHNodes);
+        refit.layout.size = offset;
+        createBuffer(refit.layout.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, refit.buffer, refit.memory);
+
+        // ؽʱͬ˳򡢽ڵɫһϴ
+        createStagingRing(refit.ring, resourceLayout.triangles.size + resourceLayout.BVHNodes.size + resourceLayout.triangleShading.size + refit.layout.size);
+        stageRefitTopology(refit.ring);
+        finishStagingUploads(refit.ring);
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &refit.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create refit descriptor pool!");
+        }
 
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
-
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0] * 6 + 0.2,
-                    attrib.vertices[3 * index.vertex_index + 1] * 6 - 1,
-                    attrib.vertices[3 * index.vertex_index + 2] * 6
-                };
-
-                /*vertex.norm = {
-                    attrib.normals[3 * index.normal_index + 0],
-                    attrib.normals[3 * index.normal_index + 1],
-                    attrib.normals[3 * index.normal_index + 2],
-                };*/
-                vertex.color = { 1,0.6,0.8 };
-                vertex.roughness = 0.5;
-                /*vertex.texCoord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };*/
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = refit.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &refit.setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &refit.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate refit descriptor set!");
+        }
 
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
+        std::array<VkDescriptorBufferInfo, 8> bufferInfos{};
+        bufferInfos[0] = resourceBufferInfo(resourceLayout.vertices);
+        bufferInfos[1] = resourceBufferInfo(resourceLayout.indices);
+        bufferInfos[2] = resourceBufferInfo(resourceLayout.triangles);
+        bufferInfos[3] = resourceBufferInfo(resourceLayout.BVHNodes);
+        bufferInfos[4] = resourceBufferInfo(resourceLayout.trianglePositions);
+        const std::array<const BufferRegion*, 3> refitRegions = { &refit.layout.parents, &refit.layout.leaves, &refit.layout.flags };
+        for (size_t i = 0; i < refitRegions.size(); i++) {
+            bufferInfos[5 + i].buffer = refit.buffer;
+            bufferInfos[5 + i].offset = refitRegions[i]->offset;
+            bufferInfos[5 + i].range = refitRegions[i]->size;
+        }
+        std::array<VkWriteDescriptorSet, 8> descriptorWrites{};
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = refit.descriptorSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    void destroyDynamicRefit() {
+        DynamicRefit& refit = dynamicRefit;
+        destroyStagingRing(refit.ring);
+        destroyBuffer(refit.buffer, refit.memory);
+        for (VkPipeline pipeline : refit.pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        vkDestroyDescriptorPool(device, refit.descriptorPool, nullptr);
+        vkDestroyPipelineLayout(device, refit.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, refit.setLayout, nullptr);
+        refit = DynamicRefit{};
+    }
 
-                indices.push_back(uniqueVertices[vertex]);
+    // ɵǰ BVHNodes 󸸽ڵҶбֻһӽڵڲڵֵΪ 1һ̼߳ɺϲ
+    void stageRefitTopology(StagingRing& ring) {
+        DynamicRefit& refit = dynamicRefit;
+        std::vector<int> parents(sceneCounts.BVHNodes, -1);
+        std::vector<uint32_t> flagInit(sceneCounts.BVHNodes, 0);
+        std::vector<int> leaves;
+        leaves.reserve(triangles.size());
+        for (size_t id = 0; id < BVHNodes.size(); id++) {
+            const BVHNode& node = BVHNodes[id];
+            if (node.n > 0) {
+                leaves.push_back(static_cast<int>(id));
+                continue;
             }
+            if (node.left > 0) parents[node.left] = static_cast<int>(id);
+            if (node.right > 0) parents[node.right] = static_cast<int>(id);
+            if ((node.left > 0) != (node.right > 0)) flagInit[id] = 1;
         }
-        uint32_t index = vertices.size();
-        vertex.pos = { 1,-1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,-1,1 };vertex.color = { 1,1,1 };vertices.push_back(vertex);
-        vertex.pos = { 1,-1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
-        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+        refit.leafCount = static_cast<uint32_t>(leaves.size());
 
-        vertex.pos = { 1,1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
-        vertex.pos = { 1,1,1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,1,-1 }; vertex.color = { 1,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,-1 }; vertex.color = { 1,1,1 };  vertices.push_back(vertex);
+        stageUpload(ring, refit.buffer, refit.layout.parents.offset, parents.data(), sizeof(int) * parents.size());
+        stageUpload(ring, refit.buffer, refit.layout.leaves.offset, leaves.data(), sizeof(int) * leaves.size());
+        stageUpload(ring, refit.buffer, refit.layout.flagInit.offset, flagInit.data(), sizeof(uint32_t) * flagInit.size());
+    }
 
-        vertex.pos = { -1,1,-1 }; vertex.color = { 1,0.5,0.5 };  vertices.push_back(vertex);
-        vertex.pos = { 1,1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
-        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
-        vertex.pos = { 1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
-        vertex.pos = { -1,-1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,-1 }; vertex.color = { 1,0.5,0.5 }; vertices.push_back(vertex);
+    // ģƴĵֱתupdateUniformBuffer еľԭ z תģת
+    void updateModelTransform() {
+        static auto startTime = std::chrono::high_resolution_clock::now();
 
-        vertex.pos = { -1,1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,-1 }; vertex.color = { 0.5,0.5,1 };  vertices.push_back(vertex);
-        vertex.pos = { -1,-1,-1 }; vertex.color = { 0.5,0.5,1 };  vertices.push_back(vertex);
-        vertex.pos = { -1,-1,-1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,-1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
-        vertex.pos = { -1,1,1 }; vertex.color = { 0.5,0.5,1 }; vertices.push_back(vertex);
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
-        vertex.pos = { 1,1,1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,1,-1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,-1,-1 }; vertex.color = { 0,1,1 };vertices.push_back(vertex);
-        vertex.pos = { 1,-1,-1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,-1,1 }; vertex.color = { 0,1,1 }; vertices.push_back(vertex);
-        vertex.pos = { 1,1,1 }; vertex.color = { 0,1,1 };vertices.push_back(vertex);
+        modelTransform = glm::translate(glm::mat4(1.0f), modelPivot)
+            * glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f))
+            * glm::translate(glm::mat4(1.0f), -modelPivot);
+    }
 
-        vertex.pos = { 0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        vertex.pos = { -0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        vertex.pos = { -0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        vertex.pos = { 0.4,0.99,0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        vertex.pos = { 0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        vertex.pos = { -0.4,0.99,-0.4 }; vertex.color = { 1,1,1 }; vertex.emissive = true; vertices.push_back(vertex);
-        
+    // ÿ֡±任ÿ REFIT_CHECK_INTERVAL ֡ѵǰ̨̬߳Ҫʱں̨ؽ
+    void updateDynamicGeometry() {
+        updateModelTransform();
+
+        if (rebuildJob.valid()) {
+            if (rebuildJob.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+            BVHRebuildResult result = rebuildJob.get();
+            if (result.rebuilt) {
+                triangles = std::move(result.triangles);
+                BVHNodes = std::move(result.nodes);
+                trianglePositions = std::move(result.positions);
+                triangleShading = std::move(result.shading);
+                bvhNodeCount = BVHNodes.size();
+                builtSAHCost = result.rebuiltCost;
+                uploadRebuiltBVH();
+                std::cout << "\nBVH refit SAH cost " << result.refitCost << " exceeded " << rebuildThreshold
+                    << "x the build cost, rebuilt in " << result.buildMs << " ms (SAH cost " << result.rebuiltCost << ")" << std::endl;
+            }
+        }
 
-        std::vector<uint32_t> v = { index,index + 1,index + 2,index + 3,index + 4,index + 5 ,index + 6,index + 7,index + 8 ,index + 9,index + 10,index + 11,
-        index + 12,index + 13,index + 14 ,index + 15,index + 16,index + 17 ,index + 18,index + 19,index + 20 ,index + 21,index + 22,index + 23 ,
-        index + 24,index + 25,index + 26 ,index + 27,index + 28,index + 29 ,index + 30,index + 31,index + 32 ,index + 33,index + 34,index + 35 };
-        indices.insert(indices.end(), v.begin(), v.end());
-        for (int i = 0; i < indices.size(); i += 3)
-            triangles.push_back(i / 3);
+        if (++framesSinceCheck < REFIT_CHECK_INTERVAL) return;
+        framesSinceCheck = 0;
+        glm::mat4 model = modelTransform;
+        rebuildJob = std::async(std::launch::async, [this, model]() { return evaluateRefitQuality(model); });
     }
 
-    bool cmpx(const uint32_t& t1, const uint32_t& t2) {
-        if (t1 == t2) return false;
-        glm::vec3 center1 = vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos;
-        glm::vec3 center2 = vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos;
-        if (center1.x = center2.x)   return t1 < t2;
-        return center1.x < center2.x; 
-    }
-    bool cmpy(const uint32_t& t1, const uint32_t& t2) {
-        if (t1 == t2) return false;
-        glm::vec3 center1 = (vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos);
-        glm::vec3 center2 = (vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos);
-        if (center1.y = center2.y)   return t1 < t2;
-        return center1.y < center2.y;
-    }
-    bool cmpz(const uint32_t& t1, const uint32_t& t2) {
-        if (t1 == t2) return false;
-        glm::vec3 center1 = (vertices[indices[3 * triangles[t1]]].pos + vertices[indices[3 * triangles[t1] + 1]].pos + vertices[indices[3 * triangles[t1] + 2]].pos);
-        glm::vec3 center2 = (vertices[indices[3 * triangles[t2]]].pos + vertices[indices[3 * triangles[t2] + 1]].pos + vertices[indices[3 * triangles[t2] + 2]].pos);
-        if (center1.z = center2.z)   return t1 < t2;
-        return center1.z < center2.z;
-    }
+    // ںִ̨߳УֻԱ result УԱֻ߳ get() ֮дĶȡص
+    BVHRebuildResult evaluateRefitQuality(const glm::mat4& model) {
+        BVHRebuildResult result;
+        std::vector<Vertex> posed = vertices;
+        for (size_t i = 0; i < modelVertexCount; i++) {
+            posed[i].pos = glm::vec3(model * glm::vec4(posed[i].pos, 1.0f));
+        }
 
-    int createBVH(std::vector<BVHNode>& nodes, int l, int r, int n) {
-        if (l > r) return 0;
-        nodes.push_back(BVHNode());
-        int id = nodes.size() - 1;
-        nodes[id].left = nodes[id].right = nodes[id].n = nodes[id].index = 0;
-        glm::vec3 AA = { 3,3,3 };
-        glm::vec3 BB = { -3,-3,-3 };
-        for (int i = l; i <= r; ++i) {
-            // С AA
-            float minx = fmin(vertices[indices[3 * triangles[i]]].pos.x, fmin(vertices[indices[3 * triangles[i] + 1]].pos.x, vertices[indices[3 * triangles[i] + 2]].pos.x));
-            float miny = fmin(vertices[indices[3 * triangles[i]]].pos.y, fmin(vertices[indices[3 * triangles[i] + 1]].pos.y, vertices[indices[3 * triangles[i] + 2]].pos.y));
-            float minz = fmin(vertices[indices[3 * triangles[i]]].pos.z, fmin(vertices[indices[3 * triangles[i] + 1]].pos.z, vertices[indices[3 * triangles[i] + 2]].pos.z));
-            AA.x = fmin(AA.x, minx);
-            AA.y = fmin(AA.y, miny);
-            AA.z = fmin(AA.z, minz);
-            float maxx = fmax(vertices[indices[3 * triangles[i]]].pos.x, fmax(vertices[indices[3 * triangles[i] + 1]].pos.x, vertices[indices[3 * triangles[i] + 2]].pos.x));
-            float maxy = fmax(vertices[indices[3 * triangles[i]]].pos.y, fmax(vertices[indices[3 * triangles[i] + 1]].pos.y, vertices[indices[3 * triangles[i] + 2]].pos.y));
-            float maxz = fmax(vertices[indices[3 * triangles[i]]].pos.z, fmax(vertices[indices[3 * triangles[i] + 1]].pos.z, vertices[indices[3 * triangles[i] + 2]].pos.z));
-            BB.x = fmax(BB.x, maxx);
-            BB.y = fmax(BB.y, maxy);
-            BB.z = fmax(BB.z, maxz);
+        //  GPU ϵͬ˲䣬ֻײ
+        std::vector<BVHNode> refitted = BVHNodes;
+        if (!refitted.empty()) {
+            refitBVHNode(refitted, 0, posed);
         }
-        nodes[id].AA = AA;
-        nodes[id].BB = BB;
-        //  n  Ҷӽڵ
-        if ((r - l + 1) <= n) {
-            nodes[id].n = r - l + 1;
-            nodes[id].index = l;
-            return id;
+        result.refitCost = computeSAHCost(refitted);
+        if (result.refitCost <= builtSAHCost * rebuildThreshold) {
+            return result;
         }
-        // ݹ齨(SAHŻ)
-        float Cost = INFINITY;
-        int Axis = 0;
-        int Split = (l + r) / 2;
-        for (int axis = 0; axis < 3; ++axis) {
-            // ֱ xyz 
-            if (axis == 0) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-                return cmpx(t1, t2);  
-                });
-            if (axis == 1) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-                return cmpy(t1, t2);  
-                });
-            if (axis == 2) std::sort(triangles.begin() + l, triangles.begin() + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-                return cmpz(t1, t2);  
-                });
-            // leftMax[i]: [l, i]  xyz ֵ
-            // leftMin[i]: [l, i] С xyz ֵ
-            std::vector<glm::vec3> leftMax(r - l + 1, glm::vec3(-INFINITY, -INFINITY, -INFINITY));
-            std::vector<glm::vec3> leftMin(r - l + 1, glm::vec3(INFINITY, INFINITY, INFINITY));
-            // ǰ׺ ע i-l Զ뵽± 0
-            for (int i = l; i <= r; i++) {
-                glm::vec3 p1 = vertices[indices[3 * triangles[i]]].pos;
-                glm::vec3 p2 = vertices[indices[3 * triangles[i] + 1]].pos;
-                glm::vec3 p3 = vertices[indices[3 * triangles[i] + 2]].pos;
-
-                int bias = (i == l) ? 0 : 1;  // һԪ⴦
-
-                leftMax[i - l].x = fmax(leftMax[i - l - bias].x, fmax(p1.x, fmax(p2.x, p3.x)));
-                leftMax[i - l].y = fmax(leftMax[i - l - bias].y, fmax(p1.y, fmax(p2.y, p3.y)));
-                leftMax[i - l].z = fmax(leftMax[i - l - bias].z, fmax(p1.z, fmax(p2.z, p3.z)));
-
-                leftMin[i - l].x = fmin(leftMin[i - l - bias].x, fmin(p1.x, fmin(p2.x, p3.x)));
-                leftMin[i - l].y = fmin(leftMin[i - l - bias].y, fmin(p1.y, fmin(p2.y, p3.y)));
-                leftMin[i - l].z = fmin(leftMin[i - l - bias].z, fmin(p1.z, fmin(p2.z, p3.z)));
-            }
-            std::vector<glm::vec3> rightMax(r - l + 1, glm::vec3(-INFINITY, -INFINITY, -INFINITY));
-            std::vector<glm::vec3> rightMin(r - l + 1, glm::vec3(INFINITY, INFINITY, INFINITY));
-            // ׺ ע i-l Զ뵽± 0
-            for (int i = r; i >= l; i--) {
-                glm::vec3 p1 = vertices[indices[3 * triangles[i]]].pos;
-                glm::vec3 p2 = vertices[indices[3 * triangles[i] + 1]].pos;
-                glm::vec3 p3 = vertices[indices[3 * triangles[i] + 2]].pos;
-                int bias = (i == r) ? 0 : 1;  // һԪ⴦
-
-                rightMax[i - l].x = fmax(rightMax[i - l + bias].x, fmax(p1.x, fmax(p2.x, p3.x)));
-                rightMax[i - l].y = fmax(rightMax[i - l + bias].y, fmax(p1.y, fmax(p2.y, p3.y)));
-                rightMax[i - l].z = fmax(rightMax[i - l + bias].z, fmax(p1.z, fmax(p2.z, p3.z)));
 
-                rightMin[i - l].x = fmin(rightMin[i - l + bias].x, fmin(p1.x, fmin(p2.x, p3.x)));
-                rightMin[i - l].y = fmin(rightMin[i - l + bias].y, fmin(p1.y, fmin(p2.y, p3.y)));
-                rightMin[i - l].z = fmin(rightMin[i - l + bias].z, fmin(p1.z, fmin(p2.z, p3.z)));
-            }
-            // Ѱҷָ
-            float cost = INFINITY;
-            int split = l;
-            for (int i = l; i <= r - 1; i++) {
-                float lenx, leny, lenz;
-                //  [l, i]
-                glm::vec3 leftAA = leftMin[i - l];
-                glm::vec3 leftBB = leftMax[i - l];
-                lenx = leftBB.x - leftAA.x;
-                leny = leftBB.y - leftAA.y;
-                lenz = leftBB.z - leftAA.z;
-                float leftS = 2.0 * ((lenx * leny) + (lenx * lenz) + (leny * lenz));
-                float leftCost = leftS * (i - l + 1);
+        // ڵǰ̬ؽtriangles ͬʱ triangleShading ˳
+        result.triangles = triangles;
+        BVHBuildContext ctx{ posed, result.triangles };
+        BVHBuildStats stats = runBVHBuilder(bvhSettings.builder, ctx, result.nodes);
+        gatherTriangles(posed, result.triangles, result.positions, result.shading);
 
-                // Ҳ [i+1, r]
-                glm::vec3 rightAA = rightMin[i + 1 - l];
-                glm::vec3 rightBB = rightMax[i + 1 - l];
-                lenx = rightBB.x - rightAA.x;
-                leny = rightBB.y - rightAA.y;
-                lenz = rightBB.z - rightAA.z;
-                float rightS = 2.0 * ((lenx * leny) + (lenx * lenz) + (leny * lenz));
-                float rightCost = rightS * (r - i);
+        result.rebuilt = true;
+        result.rebuiltCost = stats.sahCost;
+        result.buildMs = stats.buildMs;
+        return result;
+    }
 
-                // ¼ÿָС
-                float totalCost = leftCost + rightCost;
-                if (totalCost < cost) {
-                    cost = totalCost;
-                    split = i;
+    void refitBVHNode(std::vector<BVHNode>& nodes, int id, const std::vector<Vertex>& posed) {
+        glm::vec3 AA(std::numeric_limits<float>::max());
+        glm::vec3 BB(-std::numeric_limits<float>::max());
+        if (nodes[id].n > 0) {
+            for (int i = nodes[id].index; i < nodes[id].index + nodes[id].n; i++) {
+                uint32_t t = triangles[i];
+                for (int k = 0; k < 3; k++) {
+                    const glm::vec3& p = posed[indices[3 * t + k]].pos;
+                    AA = glm::min(AA, p);
+                    BB = glm::max(BB, p);
                 }
             }
-            // ¼ÿѴ
-            if (cost < Cost) {
-                Cost = cost;
-                Axis = axis;
-                Split = split;
+        }
+        else {
+            for (int child : { nodes[id].left, nodes[id].right }) {
+                if (child <= 0) continue;
+                refitBVHNode(nodes, child, posed);
+                AA = glm::min(AA, nodes[child].AA);
+                BB = glm::max(BB, nodes[child].BB);
             }
         }
-        // ָ
-        if (Axis == 0) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-            return cmpx(t1, t2);  // óԱ
-            });
-        if (Axis == 1) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-            return cmpy(t1, t2);  // óԱ
-            });
-        if (Axis == 2) std::sort(&triangles[0] + l, &triangles[0] + r + 1, [this](const uint32_t& t1, const uint32_t& t2) {
-            return cmpz(t1, t2);  // óԱ
-            });
+        nodes[id].AA = AA;
+        nodes[id].BB = BB;
+    }
 
-        // ݹ
-        int left = createBVH(nodes, l, Split, n);
-        int right = createBVH(nodes, Split + 1, r, n);
+    // ˳򡢽ڵ滻λúײһ֡ɼɫ
+    void uploadRebuiltBVH() {
+        // ֻύ֡ص豸Уϴ staging ۵դ
+        vkWaitForFences(device, static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+
+        StagingRing& ring = dynamicRefit.ring;
+        stageUpload(ring, resourceBuffer, resourceLayout.triangles.offset, triangles.data(), sizeof(uint32_t) * triangles.size());
+        stageUpload(ring, resourceBuffer, resourceLayout.BVHNodes.offset, BVHNodes.data(), sizeof(BVHNode) * BVHNodes.size());
+        stageUpload(ring, resourceBuffer, resourceLayout.triangleShading.offset, triangleShading.data(), sizeof(TriangleShading) * triangleShading.size());
+        stageRefitTopology(ring);
+        finishStagingUploads(ring);
+    }
 
-        nodes[id].left = left;
-        nodes[id].right = right;
+    void recordDynamicRefit(VkCommandBuffer commandBuffer) {
+        const DynamicRefit& refit = dynamicRefit;
 
-        return id;
+        // ֮ǰύ֡κͽڵܸ֮д
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = refit.layout.flagInit.offset;
+        copyRegion.dstOffset = refit.layout.flags.offset;
+        copyRegion.size = refit.layout.flags.size;
+        vkCmdCopyBuffer(commandBuffer, refit.buffer, refit.buffer, 1, &copyRegion);
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        RefitConstants constants{};
+        constants.model = modelTransform;
+        constants.triangleCount = static_cast<uint32_t>(sceneCounts.triangles);
+        constants.dynamicTriangleCount = static_cast<uint32_t>(modelTriangleCount);
+        constants.leafCount = refit.leafCount;
+        dispatchRefitPass(commandBuffer, REFIT_TRANSFORM, constants, groupsFor(constants.triangleCount, REFIT_WORKGROUP_SIZE));
+        computeBarrier(commandBuffer);
+        dispatchRefitPass(commandBuffer, REFIT_NODES, constants, groupsFor(constants.leafCount, REFIT_WORKGROUP_SIZE));
+
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    void dispatchRefitPass(VkCommandBuffer commandBuffer, RefitPass pass, RefitConstants constants, uint32_t groups) {
+        if (groups == 0) return;
+        constants.groupCount = groups;
+        uint32_t x = std::min(groups, MAX_DISPATCH_GROUPS);
+        uint32_t y = groupsFor(groups, x);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, dynamicRefit.pipelines[pass]);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, dynamicRefit.pipelineLayout, 0, 1, &dynamicRefit.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, dynamicRefit.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RefitConstants), &constants);
+        vkCmdDispatch(commandBuffer, x, y, 1);
+    }
+
+    // 㰴 RESOURCE_ALIGNMENT 룬 minStorageBufferOffsetAlignmentֱܷΪ洢
+    void computeResourceLayout() {
+        VkDeviceSize offset = 0;
+        auto place = [&](BufferRegion& region, VkDeviceSize size) {
+            region.offset = offset;
+            region.size = size;
+            offset = alignUp(offset + size, RESOURCE_ALIGNMENT);
+        };
+        place(resourceLayout.vertices, sizeof(Vertex) * sceneCounts.vertices);
+        place(resourceLayout.indices, sizeof(uint32_t) * sceneCounts.indices);
+        place(resourceLayout.triangles, sizeof(uint32_t) * sceneCounts.triangles);
+        place(resourceLayout.BVHNodes, sizeof(BVHNode) * sceneCounts.BVHNodes);
+        place(resourceLayout.wideNodes, sizeof(WideBVHChild) * sceneCounts.wideNodes);
+        place(resourceLayout.trianglePositions, sizeof(TrianglePositions) * sceneCounts.triangles);
+        place(resourceLayout.triangleShading, sizeof(TriangleShading) * sceneCounts.triangles);
+        resourceLayout.size = offset;
     }
 
     void createResourceBuffer() {
-        VkDeviceSize vertexAllocSize = sizeof(Vertex) * vertices.size();
-        VkDeviceSize indexAllocSize = sizeof(uint32_t) * indices.size();
-        VkDeviceSize triangleAllocSize = sizeof(uint32_t) * triangles.size();
-        VkDeviceSize BVHNodeAllocSize = sizeof(BVHNode) * BVHNodes.size();
+        computeResourceLayout();
+        const ResourceLayout& layout = resourceLayout;
 
-        VkDeviceSize bufferSize = vertexAllocSize + indexAllocSize + triangleAllocSize + BVHNodeAllocSize;
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        createBuffer(layout.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resourceBuffer, resourceBufferMemory);
+        //ݸɫĵ
+        VkDeviceSize screenVerticesSize = sizeof(Vertex) * screenVertices.size();
+        VkDeviceSize screenTrianglesBufferSize = screenVerticesSize + sizeof(uint32_t) * screenIndices.size();
+        createBuffer(screenTrianglesBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, screenTrianglesBuffer, screenTrianglesBufferMemory);
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t)vertexAllocSize);
-        data = (void*)((char*)data + vertexAllocSize);
-        memcpy(data, indices.data(), (size_t)indexAllocSize);
-        data= (void*)((char*)data + indexAllocSize);
-        memcpy(data, triangles.data(), (size_t)triangleAllocSize);
-        data = (void*)((char*)data + triangleAllocSize);
-        memcpy(data, BVHNodes.data(), (size_t)BVHNodeAllocSize);
+        // Դɶɣ뽨ʽ˳޹أʱֱӶӳеĶ
+        const char* payload = sceneCache.isOpen() ? sceneCache.data() + sizeof(SceneCacheHeader) : nullptr;
+        buildLightTable(payload ? reinterpret_cast<const Vertex*>(payload + layout.vertices.offset) : vertices.data(),
+            payload ? reinterpret_cast<const uint32_t*>(payload + layout.indices.offset) : indices.data(), sceneCounts.indices / 3);
+        VkDeviceSize lightBufferSize = sizeof(LightTableHeader) + sizeof(EmissiveTriangle) * std::max<size_t>(emissiveTriangles.size(), 1);
+        createBuffer(lightBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, lightBuffer, lightBufferMemory);
+
+        // GPU ʱκͽڵɼɫд룬ֻϴ
+        VkDeviceSize uploadSize = isGPUBuilder(bvhSettings.builder) ? layout.triangles.offset : layout.size;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        StagingRing ring;
+        createStagingRing(ring, uploadSize + screenTrianglesBufferSize + lightBufferSize);
+
+        if (sceneCache.isOpen()) {
+            // ļݲ־ resourceBuffer ݣֱӴӳֶϴ
+            stageUpload(ring, resourceBuffer, 0, sceneCache.data() + sizeof(SceneCacheHeader), uploadSize);
+        }
+        else {
+            stageUpload(ring, resourceBuffer, layout.vertices.offset, vertices.data(), layout.vertices.size);
+            stageUpload(ring, resourceBuffer, layout.indices.offset, indices.data(), layout.indices.size);
+            if (!isGPUBuilder(bvhSettings.builder)) {
+                stageUpload(ring, resourceBuffer, layout.triangles.offset, triangles.data(), layout.triangles.size);
+                stageUpload(ring, resourceBuffer, layout.BVHNodes.offset, BVHNodes.data(), sizeof(BVHNode) * BVHNodes.size());
+                stageUpload(ring, resourceBuffer, layout.wideNodes.offset, wideBVHNodes.data(), layout.wideNodes.size);
+                stageUpload(ring, resourceBuffer, layout.trianglePositions.offset, trianglePositions.data(), layout.trianglePositions.size);
+                stageUpload(ring, resourceBuffer, layout.triangleShading.offset, triangleShading.data(), layout.triangleShading.size);
+            }
+        }
+        stageUpload(ring, screenTrianglesBuffer, 0, screenVertices.data(), screenVerticesSize);
+        stageUpload(ring, screenTrianglesBuffer, screenVerticesSize, screenIndices.data(), sizeof(uint32_t) * screenIndices.size());
+        stageUpload(ring, lightBuffer, 0, &lightHeader, sizeof(lightHeader));
+        stageUpload(ring, lightBuffer, sizeof(lightHeader), emissiveTriangles.data(), sizeof(EmissiveTriangle) * emissiveTriangles.size());
+
+        finishStagingUploads(ring);
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "uploaded " << ring.uploaded / (1024.0 * 1024.0) << " MB in " << ring.submits << " submits through a "
+            << ring.slotSize * ring.slotCount / (1024.0 * 1024.0) << " MB staging ring: "
+            << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+        destroyStagingRing(ring);
+        sceneCache.close();
+    }
 
-        vkUnmapMemory(device, stagingBufferMemory);
+    void createStagingRing(StagingRing& ring, VkDeviceSize totalSize) {
+        // ݲһʱʵʴС䣬ҲֻȡװµĸʱĴС̶볡С޹
+        VkDeviceSize size = alignUp(std::max<VkDeviceSize>(totalSize, 1), RESOURCE_ALIGNMENT);
+        ring.slotSize = std::min(STAGING_RING_SIZE / STAGING_RING_SLOTS, size);
+        ring.slotCount = static_cast<uint32_t>(std::min<VkDeviceSize>(STAGING_RING_SLOTS, (size + ring.slotSize - 1) / ring.slotSize));
+        createBuffer(ring.slotSize * ring.slotCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            ring.buffer, ring.memory, MemoryUsage::Transient);
+        ring.mapped = ring.memory.mapped;
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT| VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resourceBuffer, resourceBufferMemory);
+        std::array<VkCommandBuffer, STAGING_RING_SLOTS> commandBuffers;
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = ring.slotCount;
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate staging command buffers!");
+        }
 
-        copyBuffer(stagingBuffer, resourceBuffer, bufferSize);
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        for (uint32_t i = 0; i < ring.slotCount; i++) {
+            StagingSlot& slot = ring.slots[i];
+            slot.offset = ring.slotSize * i;
+            slot.commandBuffer = commandBuffers[i];
+            if (vkCreateFence(device, &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create staging fence!");
+            }
+        }
+    }
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-        //ݸɫĵ
-        VkDeviceSize screenTrianglesBufferSize = sizeof(Vertex) * screenVertices.size() + sizeof(uint32_t) * screenIndices.size();
-        VkBuffer screenStagingBuffer;
-        VkDeviceMemory screenStagingBufferMemory;
-        createBuffer(screenTrianglesBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, screenStagingBuffer, screenStagingBufferMemory);
+    void destroyStagingRing(StagingRing& ring) {
+        for (uint32_t i = 0; i < ring.slotCount; i++) {
+            vkDestroyFence(device, ring.slots[i].fence, nullptr);
+            vkFreeCommandBuffers(device, commandPool, 1, &ring.slots[i].commandBuffer);
+        }
+        destroyBuffer(ring.buffer, ring.memory);
+        ring = StagingRing{};
+    }
 
-        void* screenData;
-        vkMapMemory(device, screenStagingBufferMemory, 0, screenTrianglesBufferSize, 0, &screenData);
-        memcpy(screenData, screenVertices.data(), (size_t)sizeof(Vertex) * screenVertices.size());
-        screenData = (void*)((char*)screenData + sizeof(Vertex) * screenVertices.size());
-        memcpy(screenData, screenIndices.data(), (size_t)sizeof(uint32_t) * screenIndices.size());
+    //  src  size ֽڿ dst  dstOffset ۵ʣռз֣дύ
+    void stageUpload(StagingRing& ring, VkBuffer dst, VkDeviceSize dstOffset, const void* src, VkDeviceSize size) {
+        const char* bytes = static_cast<const char*>(src);
+        while (size > 0) {
+            StagingSlot& slot = ring.slots[ring.current];
+            if (!slot.recording) {
+                beginStagingSlot(slot);
+            }
+            VkDeviceSize chunk = std::min(size, ring.slotSize - slot.used);
+            memcpy(ring.mapped + slot.offset + slot.used, bytes, (size_t)chunk);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = slot.offset + slot.used;
+            copyRegion.dstOffset = dstOffset;
+            copyRegion.size = chunk;
+            vkCmdCopyBuffer(slot.commandBuffer, ring.buffer, dst, 1, &copyRegion);
+
+            slot.used += chunk;
+            bytes += chunk;
+            dstOffset += chunk;
+            size -= chunk;
+            ring.uploaded += chunk;
+            if (slot.used == ring.slotSize) {
+                submitStagingSlot(ring);
+            }
+        }
+    }
 
-        vkUnmapMemory(device, screenStagingBufferMemory);
+    // һεĿ֮ǰܸе
+    void beginStagingSlot(StagingSlot& slot) {
+        if (slot.pending) {
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(device, 1, &slot.fence);
+            slot.pending = false;
+        }
+        slot.used = 0;
 
-        createBuffer(screenTrianglesBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, screenTrianglesBuffer, screenTrianglesBufferMemory);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+        slot.recording = true;
+    }
 
-        copyBuffer(screenStagingBuffer, screenTrianglesBuffer, screenTrianglesBufferSize);
+    void submitStagingSlot(StagingRing& ring) {
+        StagingSlot& slot = ring.slots[ring.current];
+        vkEndCommandBuffer(slot.commandBuffer);
 
-        vkDestroyBuffer(device, screenStagingBuffer, nullptr);
-        vkFreeMemory(device, screenStagingBufferMemory, nullptr);
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &slot.commandBuffer;
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, slot.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit staging upload!");
+        }
+        slot.recording = false;
+        slot.pending = true;
+        ring.submits++;
+        ring.current = (ring.current + 1) % ring.slotCount;
+    }
 
+    // ύδĵǰ۲ȴп
+    void finishStagingUploads(StagingRing& ring) {
+        if (ring.slots[ring.current].recording) {
+            submitStagingSlot(ring);
+        }
+        for (uint32_t i = 0; i < ring.slotCount; i++) {
+            StagingSlot& slot = ring.slots[i];
+            if (slot.pending) {
+                vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+                vkResetFences(device, 1, &slot.fence);
+                slot.pending = false;
+            }
+        }
     }
 
     void createDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 2> descPoolSizes{}; 
+        std::array<VkDescriptorPoolSize, 3> descPoolSizes{}; 
         descPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descPoolSizes[0].descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT;
+        descPoolSizes[0].descriptorCount = 8 * MAX_FRAMES_IN_FLIGHT;
         descPoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         descPoolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+        descPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descPoolSizes[2].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
         VkDescriptorPoolCreateInfo descPoolInfo{};
         descPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         descPoolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);;
-        descPoolInfo.poolSizeCount = 2;
+        descPoolInfo.poolSizeCount = static_cast<uint32_t>(descPoolSizes.size());
         descPoolInfo.pPoolSizes = descPoolSizes.data();
 
         if (vkCreateDescriptorPool(device, &descPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
@@ -1349,53 +5594,528 @@ private:
             throw std::runtime_error("failed to allocate descriptor sets!");
         }
 
-        VkDescriptorBufferInfo vertexBufferInfo{};
-        vertexBufferInfo.buffer = resourceBuffer;
-        vertexBufferInfo.offset = 0;
-        vertexBufferInfo.range = sizeof(Vertex) * vertices.size();
-
-        VkDescriptorBufferInfo indexBufferInfo{};
-        indexBufferInfo.buffer = resourceBuffer;
-        indexBufferInfo.offset = sizeof(Vertex) * vertices.size();
-        indexBufferInfo.range = sizeof(uint32_t) * indices.size();
-
-        VkDescriptorBufferInfo triangleBufferInfo{};
-        triangleBufferInfo.buffer = resourceBuffer;
-        triangleBufferInfo.offset = sizeof(Vertex) * vertices.size() + sizeof(uint32_t) * indices.size();
-        triangleBufferInfo.range = sizeof(uint32_t) * triangles.size();
-
-        VkDescriptorBufferInfo BVHBufferInfo{};
-        BVHBufferInfo.buffer = resourceBuffer;
-        BVHBufferInfo.offset = sizeof(Vertex) * vertices.size() + sizeof(uint32_t) * indices.size() + sizeof(uint32_t) * triangles.size();
-        BVHBufferInfo.range = sizeof(BVHNode) * BVHNodes.size();
+        VkDescriptorBufferInfo trianglePositionBufferInfo = resourceBufferInfo(resourceLayout.trianglePositions);
+        VkDescriptorBufferInfo triangleShadingBufferInfo = resourceBufferInfo(resourceLayout.triangleShading);
+        VkDescriptorBufferInfo BVHBufferInfo = resourceBufferInfo(resourceLayout.BVHNodes);
+        // ģʽɫʰ 5ýڵռλ
+        VkDescriptorBufferInfo wideBVHBufferInfo = resourceBufferInfo(resourceLayout.wideNodes.size == 0 ? resourceLayout.BVHNodes : resourceLayout.wideNodes);
 
         VkDescriptorImageInfo changeImgBufferInfo{};
         changeImgBufferInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
         changeImgBufferInfo.imageView = changeImageView;
         changeImgBufferInfo.sampler = changSampler;
+        VkDescriptorImageInfo compensationInfo{ VK_NULL_HANDLE, compensationImageView, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo sampleCountInfo{ VK_NULL_HANDLE, sampleCountImageView, VK_IMAGE_LAYOUT_GENERAL };
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+            VkDescriptorBufferInfo statsBufferInfo{};
+            statsBufferInfo.buffer = statsBuffer;
+            statsBufferInfo.offset = statsStride * i;
+            statsBufferInfo.range = sizeof(TraversalStats);
+            VkDescriptorBufferInfo instanceBufferInfo{ instanceBuffer, instanceStride * i + instanceRegion.offset, instanceRegion.size };
+            VkDescriptorBufferInfo tlasBufferInfo{ instanceBuffer, instanceStride * i + tlasRegion.offset, tlasRegion.size };
+
+            VkDescriptorBufferInfo lightBufferInfo{ lightBuffer, 0, VK_WHOLE_SIZE };
 
-            for (int j = 0; j < 5; ++j) {
+            std::array<VkWriteDescriptorSet, 11> descriptorWrites{};
+            std::array<uint32_t, 11> bindings = { 0, 1, 3, 4, 5, 6, 7, 8, 2, COMPENSATION_BINDING, SAMPLE_COUNT_BINDING };
+
+            for (int j = 0; j < 11; ++j) {
                 descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
                 descriptorWrites[j].dstSet = descriptorSets[i];
-                descriptorWrites[j].dstBinding = j;
+                descriptorWrites[j].dstBinding = bindings[j];
                 descriptorWrites[j].dstArrayElement = 0;
                 descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
                 descriptorWrites[j].descriptorCount = 1;
             }
-            descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+            descriptorWrites[0].pBufferInfo = &trianglePositionBufferInfo;
+            descriptorWrites[1].pBufferInfo = &triangleShadingBufferInfo;
+            descriptorWrites[2].pBufferInfo = &BVHBufferInfo;
+            descriptorWrites[3].pImageInfo = &changeImgBufferInfo;
+            descriptorWrites[4].pBufferInfo = &wideBVHBufferInfo;
+            descriptorWrites[5].pBufferInfo = &statsBufferInfo;
+            descriptorWrites[6].pBufferInfo = &instanceBufferInfo;
+            descriptorWrites[7].pBufferInfo = &tlasBufferInfo;
+            descriptorWrites[8].pBufferInfo = &lightBufferInfo;
+            descriptorWrites[9].pImageInfo = &compensationInfo;
+            descriptorWrites[10].pImageInfo = &sampleCountInfo;
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+
+    // ģʽɫʰ 7/8ȻһСĻռλ
+    void createInstanceBuffer() {
+        instanceRegion = { 0, sizeof(GPUInstance) * std::max<size_t>(meshInstances.size(), 1) };
+        tlasRegion = { alignUp(instanceRegion.size, RESOURCE_ALIGNMENT), sizeof(BVHNode) * std::max<size_t>(2 * meshInstances.size(), 1) };
+        instanceStride = alignUp(tlasRegion.offset + tlasRegion.size, RESOURCE_ALIGNMENT);
+
+        VkDeviceSize bufferSize = instanceStride * MAX_FRAMES_IN_FLIGHT;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer, instanceBufferMemory);
+        instanceBufferMapped = instanceBufferMemory.mapped;
+        memset(instanceBufferMapped, 0, (size_t)bufferSize);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            writeInstanceData(i);
+        }
+    }
+
+    // ڵȵ֡դãGPU ͬʱһ
+    void writeInstanceData(uint32_t frame) {
+        if (meshInstances.empty()) return;
+        buildTLAS();
+        char* slice = (char*)instanceBufferMapped + instanceStride * frame;
+        GPUInstance* out = reinterpret_cast<GPUInstance*>(slice + instanceRegion.offset);
+        for (size_t i = 0; i < meshInstances.size(); i++) {
+            const MeshInstance& instance = meshInstances[i];
+            out[i] = { glm::inverse(instance.transform), instance.transform, meshes[instance.mesh].root, static_cast<int32_t>(instance.mesh), { 0, 0 } };
+        }
+        memcpy(slice + tlasRegion.offset, tlasNodes.data(), sizeof(BVHNode) * tlasNodes.size());
+    }
+
+    // ÿģʵֱתתٸͬ
+    void animateInstances() {
+        static auto startTime = std::chrono::high_resolution_clock::now();
+
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        const Mesh& model = meshes[MESH_MODEL];
+        glm::vec3 pivot = (model.AA + model.BB) * 0.5f;
+        for (size_t i = 0; i < meshInstances.size(); i++) {
+            MeshInstance& instance = meshInstances[i];
+            if (instance.mesh != MESH_MODEL) continue;
+            float speed = glm::radians(90.0f) * (1.0f + 0.25f * (i % 4));
+            instance.transform = instance.placement
+                * glm::translate(glm::mat4(1.0f), pivot)
+                * glm::rotate(glm::mat4(1.0f), time * speed, glm::vec3(0.0f, 1.0f, 0.0f))
+                * glm::translate(glm::mat4(1.0f), -pivot);
+        }
+    }
+
+    // ·д changeImageƬɫİ󶨱ţɫ scene_common.glsl
+    void createWavefront() {
+        Wavefront& wf = wavefront;
+        wf.extent = changeImageExtent;
+        uint32_t pixelCount = wf.extent.width * wf.extent.height;
+
+        const std::array<uint32_t, 16> storageBindings = { 0, 1, 3, 5, 6, 7, 8, 9, 10, 11, 12, 14, 2, 15, 16, 17 };
+        const std::array<uint32_t, 4> imageBindings = { 13, 18, COMPENSATION_BINDING, SAMPLE_COUNT_BINDING };   // changeImage
+        std::array<VkDescriptorSetLayoutBinding, 20> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bool image = i >= storageBindings.size();
+            bindings[i].binding = image ? imageBindings[i - storageBindings.size()] : storageBindings[i];
+            bindings[i].descriptorType = image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &wf.setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create wavefront descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(WavefrontConstants);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &wf.setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &wf.pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create wavefront pipeline layout!");
+        }
+
+        TraceSpecialization specializationData = traceSpecialization();
+        VkSpecializationInfo specializationInfo = traceSpecializationInfo(specializationData);
+        for (int pass = 0; pass < WAVEFRONT_PASS_COUNT; pass++) {
+            wf.pipelines[pass] = createComputePipeline(WAVEFRONT_SHADERS[pass], wf.pipelineLayout, &specializationInfo);
+        }
+
+        VkDeviceSize offset = 0;
+        auto place = [&](BufferRegion& region, VkDeviceSize size) {
+            region.offset = offset;
+            region.size = std::max<VkDeviceSize>(size, 16);
+            offset = alignUp(offset + region.size, RESOURCE_ALIGNMENT);
+        };
+        place(wf.layout.paths, WAVEFRONT_PATH_SIZE * pixelCount);
+        place(wf.layout.queueState, 6 * sizeof(uint32_t));
+        place(wf.layout.queues, 2 * sizeof(uint32_t) * pixelCount);
+        place(wf.layout.hits, WAVEFRONT_HIT_SIZE * pixelCount);
+        place(wf.layout.shadows, WAVEFRONT_SHADOW_SIZE * pixelCount);
+        place(wf.layout.pixelSamples, WAVEFRONT_PIXEL_SIZE * pixelCount);
+        place(wf.layout.gbuffer, WAVEFRONT_GBUFFER_SIZE * pixelCount);
+        place(wf.layout.denoise, 2 * 4 * sizeof(float) * pixelCount);
+        wf.layout.size = offset;
+        createBuffer(wf.layout.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, wf.buffer, wf.memory);
+        // صͳƴ㿪ʼ
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdFillBuffer(commandBuffer, wf.buffer, 0, VK_WHOLE_SIZE, 0);
+        endSingleTimeCommands(commandBuffer);
+
+        VkDeviceSize readbackSize = sizeof(uint32_t) * MAX_SAMPLES_PER_PASS * MAX_FRAMES_IN_FLIGHT;
+        createBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, wf.readbackBuffer, wf.readbackMemory);
+        wf.activePixels = reinterpret_cast<uint32_t*>(wf.readbackMemory.mapped);
+
+        //  changeImage ʽͬɫӳʱ߰ͬķʽȡ
+        VkFormat denoisedFormat = ACCUMULATION_FORMAT;
+        createImage(wf.extent.width, wf.extent.height, denoisedFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, wf.denoisedImage, wf.denoisedImageMemory);
+        wf.denoisedImageView = createImageView(wf.denoisedImage, denoisedFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        transitionImageLayout(wf.denoisedImage, denoisedFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[0].descriptorCount = static_cast<uint32_t>(storageBindings.size() * MAX_FRAMES_IN_FLIGHT);
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[1].descriptorCount = static_cast<uint32_t>(imageBindings.size() * MAX_FRAMES_IN_FLIGHT);
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &wf.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create wavefront descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, wf.setLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = wf.descriptorPool;
+        allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        allocInfo.pSetLayouts = layouts.data();
+        wf.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkAllocateDescriptorSets(device, &allocInfo, wf.descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate wavefront descriptor sets!");
+        }
 
-            descriptorWrites[0].pBufferInfo = &vertexBufferInfo;
-            descriptorWrites[1].pBufferInfo = &indexBufferInfo;
-            descriptorWrites[2].pBufferInfo = &triangleBufferInfo;
-            descriptorWrites[3].pBufferInfo = &BVHBufferInfo;
-            descriptorWrites[4].pImageInfo = &changeImgBufferInfo;
+        std::array<VkDescriptorImageInfo, 4> imageInfos{};
+        imageInfos[0] = { VK_NULL_HANDLE, changeImageView, VK_IMAGE_LAYOUT_GENERAL };
+        imageInfos[1] = { VK_NULL_HANDLE, wf.denoisedImageView, VK_IMAGE_LAYOUT_GENERAL };
+        imageInfos[2] = { VK_NULL_HANDLE, compensationImageView, VK_IMAGE_LAYOUT_GENERAL };
+        imageInfos[3] = { VK_NULL_HANDLE, sampleCountImageView, VK_IMAGE_LAYOUT_GENERAL };
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            std::array<VkDescriptorBufferInfo, 16> bufferInfos{};
+            bufferInfos[0] = resourceBufferInfo(resourceLayout.trianglePositions);
+            bufferInfos[1] = resourceBufferInfo(resourceLayout.triangleShading);
+            bufferInfos[2] = resourceBufferInfo(resourceLayout.BVHNodes);
+            bufferInfos[3] = resourceBufferInfo(resourceLayout.wideNodes.size == 0 ? resourceLayout.BVHNodes : resourceLayout.wideNodes);
+            bufferInfos[4] = { statsBuffer, statsStride * frame, sizeof(TraversalStats) };
+            bufferInfos[5] = { instanceBuffer, instanceStride * frame + instanceRegion.offset, instanceRegion.size };
+            bufferInfos[6] = { instanceBuffer, instanceStride * frame + tlasRegion.offset, tlasRegion.size };
+            const std::array<const BufferRegion*, 5> wavefrontRegions = { &wf.layout.paths, &wf.layout.queueState, &wf.layout.queues, &wf.layout.hits, &wf.layout.shadows };
+            for (size_t i = 0; i < wavefrontRegions.size(); i++) {
+                bufferInfos[7 + i] = { wf.buffer, wavefrontRegions[i]->offset, wavefrontRegions[i]->size };
+            }
+            bufferInfos[12] = { lightBuffer, 0, VK_WHOLE_SIZE };
+            bufferInfos[13] = { wf.buffer, wf.layout.pixelSamples.offset, wf.layout.pixelSamples.size };
+            bufferInfos[14] = { wf.buffer, wf.layout.gbuffer.offset, wf.layout.gbuffer.size };
+            bufferInfos[15] = { wf.buffer, wf.layout.denoise.offset, wf.layout.denoise.size };
+
+            std::array<VkWriteDescriptorSet, 20> descriptorWrites{};
+            for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+                descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[i].dstSet = wf.descriptorSets[frame];
+                descriptorWrites[i].dstBinding = bindings[i].binding;
+                descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+                descriptorWrites[i].descriptorCount = 1;
+                if (i < bufferInfos.size()) descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+                else descriptorWrites[i].pImageInfo = &imageInfos[i - bufferInfos.size()];
+            }
             vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
         }
     }
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    void destroyWavefront() {
+        Wavefront& wf = wavefront;
+        destroyBuffer(wf.buffer, wf.memory);
+        destroyBuffer(wf.readbackBuffer, wf.readbackMemory);
+        vkDestroyImageView(device, wf.denoisedImageView, nullptr);
+        destroyImage(wf.denoisedImage, wf.denoisedImageMemory);
+        for (VkPipeline pipeline : wf.pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        vkDestroyPipelineLayout(device, wf.pipelineLayout, nullptr);
+        vkDestroyDescriptorPool(device, wf.descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, wf.setLayout, nullptr);
+    }
+
+    // ( ->  -> (ɷ ->  -> ɫ -> Ӱ) x maxBounce -> ۻ) x samplesPerPass [-> ] -> ɫӳ䲢 blit ͼ
+    // ̶ֹ·ٽУ漸ηļɷ֮С·ֻһݣ׷
+    void recordWavefront(VkCommandBuffer commandBuffer, uint32_t imageIndex, const PushConstants& pushConstants) {
+        Wavefront& wf = wavefront;
+        WavefrontConstants constants{};
+        constants.frameCount = pushConstants.frameCount;
+        constants.maxAccumulation = pushConstants.maxAccumulation;
+        constants.width = wf.extent.width;
+        constants.height = wf.extent.height;
+        constants.maxBounce = static_cast<uint32_t>(pushConstants.maxBounce);
+        constants.rouletteDepth = pushConstants.rouletteDepth;
+        constants.rouletteProbability = pushConstants.rouletteProbability;
+        // ڶʱķû壬֡
+        constants.adaptiveError = pushConstants.maxAccumulation > 0 ? 0.0f : adaptiveError;
+        constants.adaptiveMinSamples = adaptiveMinSamples;
+        constants.denoiseIterations = static_cast<uint32_t>(denoiseIterations);
+        uint32_t pixelGroups = groupsFor(wf.extent.width * wf.extent.height, WAVEFRONT_WORKGROUP_SIZE);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wf.pipelineLayout, 0, 1, &wf.descriptorSets[currentFrame], 0, nullptr);
+        wf.readbackPasses[currentFrame] = 0;
+        for (uint32_t pass = 0; pass < pushConstants.samplesPerPass; pass++) {
+            constants.samplePass = pass;
+            recordWavefrontSample(commandBuffer, constants, pixelGroups);
+        }
+        // ֻ changeImageд denoisedImage
+        if (denoise) {
+            computeBarrier(commandBuffer);
+            dispatchWavefrontPass(commandBuffer, WAVEFRONT_DENOISE_PREPARE, constants, pixelGroups);
+            for (uint32_t iteration = 0; iteration < constants.denoiseIterations; iteration++) {
+                constants.denoiseIteration = iteration;
+                computeBarrier(commandBuffer);
+                dispatchWavefrontPass(commandBuffer, WAVEFRONT_DENOISE_ATROUS, constants, pixelGroups);
+            }
+        }
+
+        recordPresent(commandBuffer, imageIndex, denoise);
+
+        if (wf.readbackPasses[currentFrame] > 0) {
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+        }
+    }
+
+    // һֲÿڲģ׷һ·ۻӦʱһֵĻԾػ
+    void recordWavefrontSample(VkCommandBuffer commandBuffer, WavefrontConstants& constants, uint32_t pixelGroups) {
+        Wavefront& wf = wavefront;
+        VkDeviceSize indirectOffset = wf.layout.queueState.offset + 2 * sizeof(uint32_t);
+        // ·к changeImage ֻһݣ֮ǰύ֡һ֣ܸ֮дгȺؼÿ
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(commandBuffer, wf.buffer, wf.layout.queueState.offset, wf.layout.queueState.size, 0);
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        dispatchWavefrontPass(commandBuffer, WAVEFRONT_SCHEDULE, constants, pixelGroups);
+        computeBarrier(commandBuffer);
+        dispatchWavefrontPass(commandBuffer, WAVEFRONT_GENERATE, constants, pixelGroups);
+        for (uint32_t bounce = 0; bounce < constants.maxBounce; bounce++) {
+            constants.bounce = bounce;
+            computeBarrier(commandBuffer);
+            dispatchWavefrontPass(commandBuffer, WAVEFRONT_DISPATCH, constants, 1);
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            dispatchWavefrontIndirect(commandBuffer, WAVEFRONT_EXTEND, constants, indirectOffset);
+            computeBarrier(commandBuffer);
+            dispatchWavefrontIndirect(commandBuffer, WAVEFRONT_SHADE, constants, indirectOffset);
+            // һηԴûӰ
+            if (nextEventEstimation && bounce + 1 < constants.maxBounce) {
+                computeBarrier(commandBuffer);
+                dispatchWavefrontIndirect(commandBuffer, WAVEFRONT_CONNECT, constants, indirectOffset);
+            }
+        }
+        computeBarrier(commandBuffer);
+        dispatchWavefrontPass(commandBuffer, WAVEFRONT_ACCUMULATE, constants, pixelGroups);
+
+        if (constants.adaptiveError > 0.0f) {
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            VkBufferCopy copy{};
+            copy.srcOffset = wf.layout.queueState.offset + 5 * sizeof(uint32_t);
+            copy.dstOffset = sizeof(uint32_t) * (MAX_SAMPLES_PER_PASS * currentFrame + constants.samplePass);
+            copy.size = sizeof(uint32_t);
+            vkCmdCopyBuffer(commandBuffer, wf.buffer, wf.readbackBuffer, 1, &copy);
+            wf.readbackPasses[currentFrame]++;
+        }
+    }
+
+    void dispatchWavefrontPass(VkCommandBuffer commandBuffer, WavefrontPass pass, const WavefrontConstants& constants, uint32_t groups) {
+        if (groups == 0) return;
+        uint32_t x = std::min(groups, MAX_DISPATCH_GROUPS);
+        uint32_t y = groupsFor(groups, x);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefront.pipelines[pass]);
+        vkCmdPushConstants(commandBuffer, wavefront.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WavefrontConstants), &constants);
+        vkCmdDispatch(commandBuffer, x, y, 1);
+        profileMark(commandBuffer, static_cast<ProfileZone>(PROFILE_WAVEFRONT + pass));
+    }
+
+    //  wavefront_dispatch.comp гд
+    void dispatchWavefrontIndirect(VkCommandBuffer commandBuffer, WavefrontPass pass, const WavefrontConstants& constants, VkDeviceSize offset) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefront.pipelines[pass]);
+        vkCmdPushConstants(commandBuffer, wavefront.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WavefrontConstants), &constants);
+        vkCmdDispatchIndirect(commandBuffer, wavefront.buffer, offset);
+        profileMark(commandBuffer, static_cast<ProfileZone>(PROFILE_WAVEFRONT + pass));
+    }
+
+    // ֡ɺл·д changeImage ʱҪͬۻĽ
+    void switchRenderer() {
+        rendererSwitchRequested = false;
+        vkDeviceWaitIdle(device);
+        renderer = renderer == RendererType::Fragment ? RendererType::Wavefront : RendererType::Fragment;
+        memset(statsBufferMapped, 0, (size_t)(statsStride * MAX_FRAMES_IN_FLIGHT));
+        resetTraversalStats();
+        std::cout << "\nrenderer: " << rendererName(renderer) << std::endl;
+    }
+
+    // ÿ֡һݼڵȵ֡դ
+    void createTraversalStatsBuffer() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        statsStride = alignUp(sizeof(TraversalStats), std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 16));
+
+        VkDeviceSize bufferSize = statsStride * MAX_FRAMES_IN_FLIGHT;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, statsBuffer, statsBufferMemory);
+        statsBufferMapped = statsBufferMemory.mapped;
+        memset(statsBufferMapped, 0, (size_t)bufferSize);
+    }
+
+    void collectTraversalStats(uint32_t frame) {
+        if (!traversalStats) return;
+        TraversalStats* stats = reinterpret_cast<TraversalStats*>((char*)statsBufferMapped + statsStride * frame);
+        statsTotals[0] += stats->rays;
+        statsTotals[1] += stats->nodeFetches;
+        statsTotals[2] += stats->boxTests;
+        statsTotals[3] += stats->triangleTests;
+        statsTotals[4] += stats->stackTraffic;
+        statsTotals[5] += stats->culledNodes;
+        *stats = TraversalStats{};
+
+        if (++statsFrames < TRAVERSAL_STATS_INTERVAL || statsTotals[0] == 0) return;
+        auto now = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(now - statsStartTime).count();
+        double rays = (double)statsTotals[0];
+        std::cout << "\nBVH" << bvhSettings.width << " traversal (" << rendererName(renderer) << "): " << rays / seconds * 1e-6 << " Mrays/s, "
+            << statsTotals[1] / rays << " node fetches, "
+            << statsTotals[2] / rays << " box tests, " << statsTotals[3] / rays << " triangle tests, "
+            << statsTotals[5] / rays << " culled nodes, " << statsTotals[4] / rays << " spill-stack accesses per ray ("
+            << (shortStackTraversal ? "short stack" : "full stack") << ")" << std::endl;
+        resetTraversalStats();
+    }
+
+    // ۻʱΪÿ 3x3 ֵ֮ľ
+    // ԵҲ룬ֻͬһͬ֡¶ԱȲͬĲʽƽӦֲ
+    void measureNoise() {
+        bool denoised = denoise && renderer == RendererType::Wavefront;
+        uint32_t width = changeImageExtent.width;
+        uint32_t height = changeImageExtent.height;
+        // ͳõֵٽضϵ [0, 1]عΪ 1  clamp ɫӳ俴ͬ
+        std::vector<float> accumulated(4ull * width * height);
+        readBackImage(denoised ? wavefront.denoisedImage : changeImage, accumulated.data(), accumulated.size() * sizeof(float));
+        std::vector<float> pixels(3ull * width * height);
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            float count = std::max(accumulated[4 * i + 3], 1.0f);
+            for (uint32_t c = 0; c < 3; c++) {
+                pixels[3 * i + c] = std::min(std::max(accumulated[4 * i + c] / count, 0.0f), 1.0f);
+            }
+        }
+
+        double squared = 0.0, mean = 0.0;
+        size_t samples = 0;
+        for (uint32_t y = 1; y + 1 < height; y++) {
+            for (uint32_t x = 1; x + 1 < width; x++) {
+                for (uint32_t c = 0; c < 3; c++) {
+                    double neighbours = 0.0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            if (dx != 0 || dy != 0) neighbours += pixels[3 * ((y + dy) * width + x + dx) + c];
+                        }
+                    }
+                    double value = pixels[3 * (y * width + x) + c];
+                    double d = value - neighbours / 8.0;
+                    squared += d * d;
+                    mean += value;
+                    samples++;
+                }
+            }
+        }
+        samples = std::max<size_t>(samples, 1);
+        std::cout << "\nnoise after " << noiseFrames << " frames (" << rendererName(renderer) << ", "
+            << (nextEventEstimation ? "next-event estimation + MIS" : "BSDF sampling only") << ", " << maxBounce << " bounces, roulette after "
+            << rouletteDepth << ", " << samplesPerPass << " spp per frame" << (denoised ? ", denoised" : "") << "): RMS "
+            << std::sqrt(squared / samples) << ", mean " << mean / samples << std::endl;
+
+        // οͼΪ   uint32_t ÿ RGB  float
+        if (!saveReferencePath.empty()) {
+            std::ofstream file(saveReferencePath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&width), sizeof(width));
+            file.write(reinterpret_cast<const char*>(&height), sizeof(height));
+            file.write(reinterpret_cast<const char*>(pixels.data()), (std::streamsize)(pixels.size() * sizeof(float)));
+            std::cout << (file ? "saved reference " : "cannot write reference ") << saveReferencePath << std::endl;
+        }
+        if (!referencePath.empty()) {
+            std::ifstream file(referencePath, std::ios::binary);
+            uint32_t referenceSize[2] = { 0, 0 };
+            file.read(reinterpret_cast<char*>(referenceSize), sizeof(referenceSize));
+            std::vector<float> reference(pixels.size());
+            file.read(reinterpret_cast<char*>(reference.data()), (std::streamsize)(reference.size() * sizeof(float)));
+            if (!file || referenceSize[0] != width || referenceSize[1] != height) {
+                std::cout << "reference " << referencePath << " is missing or does not match " << width << "x" << height << std::endl;
+                return;
+            }
+            double error = 0.0;
+            for (size_t i = 0; i < pixels.size(); i++) {
+                double d = pixels[i] - reference[i];
+                error += d * d;
+            }
+            std::cout << "RMSE against " << referencePath << ": " << std::sqrt(error / (3.0 * width * height)) << std::endl;
+        }
+    }
+
+    // ʱԤģʽεȵդļΪ GPU һ֡ʱ䣬Ը֡õÿֺʱ
+    // ƽԤѡһ֡ samplesPerPassֱͬʱˢڣԤӦ
+    void updateSampleBudget() {
+        auto now = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double, std::milli>(now - lastFrameDone).count();
+        lastFrameDone = now;
+        int samples = frameSamples[currentFrame];
+        if (sampleBudget <= 0.0f || samples == 0) return;
+        double perSample = elapsed / samples;
+        sampleTime = sampleTime == 0.0 ? perSample : 0.8 * sampleTime + 0.2 * perSample;
+        int next = static_cast<int>(sampleBudget / std::max(sampleTime, 1e-3));
+        samplesPerPass = std::min<int>(MAX_SAMPLES_PER_PASS, std::max(1, next));
+    }
+
+    // ֡ÿһڲһȫʱƽÿصȾԾʹ˽
+    void collectAdaptiveStats(uint32_t frame) {
+        Wavefront& wf = wavefront;
+        uint32_t passes = wf.readbackPasses[frame];
+        if (passes == 0) return;
+        wf.readbackPasses[frame] = 0;
+        uint32_t pixels = wf.extent.width * wf.extent.height;
+        uint32_t active = 0;
+        for (uint32_t pass = 0; pass < passes; pass++) {
+            active = wf.activePixels[MAX_SAMPLES_PER_PASS * frame + pass];
+            adaptivePaths += active == 0 ? 0 : static_cast<uint64_t>(active) * std::min(pixels / active, ADAPTIVE_MAX_PATHS);
+        }
+        adaptiveFrames++;
+        if (active > 0 || adaptiveConverged) return;
+
+        adaptiveConverged = true;
+        std::cout << "\nadaptive sampling converged (relative error " << adaptiveError << ") after " << adaptiveFrames << " frames, "
+            << (double)adaptivePaths / pixels << " paths per pixel on average" << std::endl;
+        if (stopWhenConverged && !headless) {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+    }
+
+    void resetTraversalStats() {
+        statsTotals = {};
+        statsFrames = 0;
+        statsStartTime = std::chrono::high_resolution_clock::now();
+    }
+
+    VkDescriptorBufferInfo resourceBufferInfo(const BufferRegion& region) {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = resourceBuffer;
+        bufferInfo.offset = region.offset;
+        bufferInfo.range = region.size;
+        return bufferInfo;
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory,
+        MemoryUsage memoryUsage = MemoryUsage::Resident) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -1409,16 +6129,13 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
+        bufferMemory = allocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), false, memoryUsage);
+        vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+    }
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    void destroyBuffer(VkBuffer buffer, Allocation& bufferMemory) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        allocator.free(bufferMemory);
     }
 
     VkCommandBuffer beginSingleTimeCommands() {
@@ -1454,10 +6171,12 @@ private:
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0) {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
         VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -1498,19 +6217,43 @@ private:
         if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
+        profileBeginFrame(commandBuffer);
+
+        if (dynamicGeometry && instanceCount == 0) {
+            recordDynamicRefit(commandBuffer);
+            profileMark(commandBuffer, PROFILE_REFIT);
+        }
+
+        static PushConstants pushConstants{};
+        pushConstants.frameCount++;
+        // ڰ֡ƣ
+        pushConstants.maxAccumulation = dynamicGeometry ? DYNAMIC_ACCUMULATION_FRAMES * samplesPerPass : 0;
+        pushConstants.maxBounce = maxBounce;
+        pushConstants.rouletteDepth = rouletteDepth;
+        pushConstants.rouletteProbability = rouletteProbability;
+        pushConstants.samplesPerPass = static_cast<uint32_t>(samplesPerPass);
+        frameSamples[currentFrame] = samplesPerPass;
+        renderedSamples += samplesPerPass;
+
+        if (renderer == RendererType::Wavefront) {
+            recordWavefront(commandBuffer, imageIndex, pushConstants);
+        }
+        else {
+            recordFragmentPass(commandBuffer, imageIndex, pushConstants);
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
 
+    void recordFragmentPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, const PushConstants& pushConstants) {
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.framebuffer = changeFramebuffer;
         renderPassInfo.renderArea.offset = { 0, 0 };
-        renderPassInfo.renderArea.extent = swapChainExtent;
-
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = { {1.0f, 1.0f, 1.0f, 1.0f} };
-
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
+        renderPassInfo.renderArea.extent = changeImageExtent;
 
         vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -1519,15 +6262,15 @@ private:
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = (float)swapChainExtent.width;
-        viewport.height = (float)swapChainExtent.height;
+        viewport.width = (float)changeImageExtent.width;
+        viewport.height = (float)changeImageExtent.height;
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
         VkRect2D scissor{};
         scissor.offset = { 0, 0 };
-        scissor.extent = swapChainExtent;
+        scissor.extent = changeImageExtent;
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
         VkDeviceSize offsets[] = { 0 };
@@ -1537,19 +6280,161 @@ private:
 
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
 
-        static PushConstants pushConstants = {0};
-        pushConstants.frameCount++;
-
         // ͳ
         vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
 
         vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(screenIndices.size()), 1, 0, 0, 0);
 
         vkCmdEndRenderPass(commandBuffer);
+        profileMark(commandBuffer, PROFILE_FRAGMENT);
+        recordPresent(commandBuffer, imageIndex, false);
+    }
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+    // ·ãۻɫӳд displayImage blit ͼתΪֲ
+    void createTonemap() {
+        Tonemap& tm = tonemap;
+        VkFormatProperties formatProperties{};
+        if (!headless) {
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &formatProperties);
+            tm.blitPresent = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
+            if (!tm.blitPresent && !copyPresentFormat(swapChainImageFormat, tm.copySwapRedBlue, tm.copyEncodeSRGB)) {
+                throw std::runtime_error("swap chain format supports neither blits nor copies from the display image!");
+            }
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &tm.setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create tonemap descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(TonemapConstants);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &tm.setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &tm.pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create tonemap pipeline layout!");
+        }
+        tm.pipeline = createComputePipeline("shaders/tonemap.spv", tm.pipelineLayout);
+
+        //  changeImage Сͬblit ʱŵͼ޴Ⱦʱд PNG
+        VkFormat displayFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        createImage(changeImageExtent.width, changeImageExtent.height, displayFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tm.displayImage, tm.displayImageMemory);
+        tm.displayImageView = createImageView(tm.displayImage, displayFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        transitionImageLayout(tm.displayImage, displayFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSize.descriptorCount = static_cast<uint32_t>(bindings.size() * tm.descriptorSets.size());
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = static_cast<uint32_t>(tm.descriptorSets.size());
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &tm.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create tonemap descriptor pool!");
+        }
+
+        std::array<VkDescriptorSetLayout, 2> layouts = { tm.setLayout, tm.setLayout };
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = tm.descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(device, &allocInfo, tm.descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate tonemap descriptor sets!");
+        }
+
+        const std::array<VkImageView, 2> sources = { changeImageView, wavefront.denoisedImageView };
+        VkDescriptorImageInfo displayInfo = { VK_NULL_HANDLE, tm.displayImageView, VK_IMAGE_LAYOUT_GENERAL };
+        for (size_t i = 0; i < sources.size(); i++) {
+            VkDescriptorImageInfo sourceInfo = { VK_NULL_HANDLE, sources[i], VK_IMAGE_LAYOUT_GENERAL };
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            for (uint32_t b = 0; b < descriptorWrites.size(); b++) {
+                descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[b].dstSet = tm.descriptorSets[i];
+                descriptorWrites[b].dstBinding = b;
+                descriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrites[b].descriptorCount = 1;
+                descriptorWrites[b].pImageInfo = b == 0 ? &sourceInfo : &displayInfo;
+            }
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+
+    void destroyTonemap() {
+        Tonemap& tm = tonemap;
+        vkDestroyImageView(device, tm.displayImageView, nullptr);
+        destroyImage(tm.displayImage, tm.displayImageMemory);
+        vkDestroyPipeline(device, tm.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, tm.pipelineLayout, nullptr);
+        vkDestroyDescriptorPool(device, tm.descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, tm.setLayout, nullptr);
+    }
+
+    // displayImage ֻһݣһ֡ blit ܸдͼתΪ TRANSFER_DSTתΪֲ
+    // ޴Ⱦûнͼֻɫӳ
+    void recordPresent(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool denoised) {
+        Tonemap& tm = tonemap;
+        TonemapConstants constants{};
+        constants.width = changeImageExtent.width;
+        constants.height = changeImageExtent.height;
+        constants.exposure = exposure;
+        constants.tonemapOperator = static_cast<uint32_t>(tonemapOperator);
+        bool copy = !headless && !tm.blitPresent;
+        constants.encodeSRGB = headless || (copy && tm.copyEncodeSRGB) ? 1 : 0;
+        constants.swapRedBlue = copy && tm.copySwapRedBlue ? 1 : 0;
+
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tm.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tm.pipelineLayout, 0, 1, &tm.descriptorSets[denoised ? 1 : 0], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, tm.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TonemapConstants), &constants);
+        vkCmdDispatch(commandBuffer, groupsFor(constants.width, TONEMAP_WORKGROUP_SIZE), groupsFor(constants.height, TONEMAP_WORKGROUP_SIZE), 1);
+        profileMark(commandBuffer, PROFILE_TONEMAP);
+        if (headless) return;
+
+        VkImage swapChainImage = swapChainImages[imageIndex];
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        imageBarrier(commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        if (copy) {
+            // ţСͬڸıСʱֻصĲ
+            VkImageCopy region{};
+            region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            region.extent = { std::min(constants.width, swapChainExtent.width), std::min(constants.height, swapChainExtent.height), 1 };
+            vkCmdCopyImage(commandBuffer, tm.displayImage, VK_IMAGE_LAYOUT_GENERAL, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+        else {
+            VkImageBlit blit{};
+            blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blit.srcOffsets[1] = { static_cast<int32_t>(constants.width), static_cast<int32_t>(constants.height), 1 };
+            blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blit.dstOffsets[1] = { static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1 };
+            vkCmdBlitImage(commandBuffer, tm.displayImage, VK_IMAGE_LAYOUT_GENERAL, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
         }
+        imageBarrier(commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        profileMark(commandBuffer, PROFILE_BLIT);
     }
 
     void createSyncObjects() {
@@ -1588,20 +6473,298 @@ private:
         memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
     }
 
-    void drawFrame() {
+    static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // ͼζв֧ʱʱֻͳ CPU ʱ
+    void createProfiler() {
+        Profiler& pf = profiler;
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        uint32_t validBits = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily.value()].timestampValidBits;
+        pf.gpuTimestamps = validBits > 0;
+        if (!pf.gpuTimestamps) {
+            std::cout << "graphics queue has no timestamp support, GPU pass timing disabled" << std::endl;
+            return;
+        }
+        pf.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        pf.timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = PROFILE_QUERIES_PER_FRAME * MAX_FRAMES_IN_FLIGHT;
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &pf.queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    // յǰ֡Ĳѯд֡ʼʱ֮ǰύɺд
+    void profileBeginFrame(VkCommandBuffer commandBuffer) {
+        Profiler& pf = profiler;
+        pf.queryCounts[currentFrame] = 0;
+        pf.zones[currentFrame].clear();
+        if (!pf.gpuTimestamps) return;
+        vkCmdResetQueryPool(commandBuffer, pf.queryPool, PROFILE_QUERIES_PER_FRAME * currentFrame, PROFILE_QUERIES_PER_FRAME);
+        profileMark(commandBuffer, PROFILE_ZONE_COUNT);
+    }
 
-        // ֡ʱ
-        t2 = clock();
-        double dt = (double)(t2 - t1) / CLOCKS_PER_SEC;
-        double fps = 1.0 / dt;
-        std::cout << "\r";
-        std::cout << "FPS : " << fps ;
-        t1 = t2;
+    // ǰɺдʱһʱ֮ʱ zone
+    void profileMark(VkCommandBuffer commandBuffer, ProfileZone zone) {
+        Profiler& pf = profiler;
+        uint32_t& count = pf.queryCounts[currentFrame];
+        if (!pf.gpuTimestamps || count == PROFILE_QUERIES_PER_FRAME) return;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pf.queryPool, PROFILE_QUERIES_PER_FRAME * currentFrame + count);
+        pf.zones[currentFrame].push_back(zone);
+        count++;
+    }
+
+    // ύ֮¼һ֡ CPU ʱ䣬GPU ʱ´εȵͬһդʱٶ
+    void beginFrameTiming(std::chrono::high_resolution_clock::time_point frameStart, double fenceWait, double acquire) {
+        Profiler& pf = profiler;
+        FrameTiming& timing = pf.pending[currentFrame];
+        timing = FrameTiming{};
+        timing.frame = ++pf.frameIndex;
+        timing.cpuFrame = std::chrono::duration<double, std::milli>(frameStart - pf.frameStart).count();
+        timing.fenceWait = fenceWait;
+        timing.acquire = acquire;
+        pf.frameStart = frameStart;
+    }
+
+    // դѾʱһã WAIT ־ȡ
+    void collectProfile(uint32_t frame) {
+        Profiler& pf = profiler;
+        FrameTiming& timing = pf.pending[frame];
+        if (timing.frame == 0) return;
+        uint32_t count = pf.queryCounts[frame];
+        if (pf.gpuTimestamps && count > 1) {
+            std::vector<uint64_t> stamps(count);
+            if (vkGetQueryPoolResults(device, pf.queryPool, PROFILE_QUERIES_PER_FRAME * frame, count, sizeof(uint64_t) * count, stamps.data(),
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                auto milliseconds = [&](uint64_t from, uint64_t to) { return ((to - from) & pf.timestampMask) * pf.timestampPeriod * 1e-6; };
+                for (uint32_t i = 1; i < count; i++) {
+                    timing.gpu[pf.zones[frame][i]] += milliseconds(stamps[i - 1], stamps[i]);
+                }
+                timing.gpuTotal = milliseconds(stamps[0], stamps[count - 1]);
+            }
+        }
+        // һ֡ļʼ
+        if (timing.frame > 1) pf.frameTimes.add(timing.cpuFrame);
+        pf.fenceWaits.add(timing.fenceWait);
+        pf.acquires.add(timing.acquire);
+        pf.gpuTimes.add(timing.gpuTotal);
+        for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+            pf.intervalZones[zone] += timing.gpu[zone];
+        }
+        pf.intervalFrames++;
+        if (!profileOutputPath.empty()) pf.trace.push_back(timing);
+        timing.frame = 0;
+        printProfileSummary();
+    }
+
+    // ÿ PROFILE_SUMMARY_SECONDS ӡһΰٷλ͸ GPU εƽʱ䣬ÿ֡ FPS
+    void printProfileSummary() {
+        Profiler& pf = profiler;
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - pf.lastSummary).count();
+        if (seconds < PROFILE_SUMMARY_SECONDS || pf.intervalFrames == 0) return;
+        auto percentiles = [](const RollingStat& stat) {
+            std::ostringstream text;
+            text << stat.percentile(0.5) << "/" << stat.percentile(0.95) << "/" << stat.percentile(0.99);
+            return text.str();
+        };
+        std::cout << "\n" << pf.intervalFrames / seconds << " fps, p50/p95/p99 ms: frame " << percentiles(pf.frameTimes)
+            << ", fence wait " << percentiles(pf.fenceWaits) << ", acquire " << percentiles(pf.acquires);
+        if (pf.gpuTimestamps) {
+            std::cout << ", GPU " << percentiles(pf.gpuTimes) << std::endl;
+            std::vector<int> zones(PROFILE_ZONE_COUNT);
+            std::iota(zones.begin(), zones.end(), 0);
+            std::sort(zones.begin(), zones.end(), [&](int a, int b) { return pf.intervalZones[a] > pf.intervalZones[b]; });
+            std::cout << "GPU passes (mean ms):";
+            for (int zone : zones) {
+                if (pf.intervalZones[zone] <= 0.0) break;
+                std::cout << " " << PROFILE_ZONE_NAMES[zone] << " " << pf.intervalZones[zone] / pf.intervalFrames;
+            }
+        }
+        std::cout << std::endl;
+        pf.intervalZones = {};
+        pf.intervalFrames = 0;
+        pf.lastSummary = std::chrono::high_resolution_clock::now();
+    }
+
+    // ˳ǰ豸ѿУûռ֡д֡¼
+    void finishProfile() {
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            collectProfile(frame);
+        }
+        if (profileOutputPath.empty()) return;
+
+        const std::vector<FrameTiming>& trace = profiler.trace;
+        std::ofstream file(profileOutputPath, std::ios::trunc);
+        if (std::filesystem::path(profileOutputPath).extension() == ".json") {
+            file << "{\n  \"renderer\": \"" << rendererName(renderer) << "\",\n  \"gpuTimestamps\": " << (profiler.gpuTimestamps ? "true" : "false")
+                << ",\n  \"frames\": [";
+            for (size_t i = 0; i < trace.size(); i++) {
+                const FrameTiming& t = trace[i];
+                file << (i == 0 ? "\n" : ",\n") << "    { \"frame\": " << t.frame << ", \"cpuFrameMs\": " << t.cpuFrame << ", \"fenceWaitMs\": " << t.fenceWait
+                    << ", \"acquireMs\": " << t.acquire << ", \"gpuMs\": " << t.gpuTotal << ", \"passes\": {";
+                for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+                    file << (zone == 0 ? " " : ", ") << "\"" << PROFILE_ZONE_NAMES[zone] << "\": " << t.gpu[zone];
+                }
+                file << " } }";
+            }
+            file << "\n  ]\n}\n";
+        }
+        else {
+            file << "frame,cpu_frame_ms,fence_wait_ms,acquire_ms,gpu_ms";
+            for (const char* name : PROFILE_ZONE_NAMES) {
+                file << "," << name << "_ms";
+            }
+            file << "\n";
+            for (const FrameTiming& t : trace) {
+                file << t.frame << "," << t.cpuFrame << "," << t.fenceWait << "," << t.acquire << "," << t.gpuTotal;
+                for (double ms : t.gpu) {
+                    file << "," << ms;
+                }
+                file << "\n";
+            }
+        }
+        std::cout << (file ? "wrote frame timings to " : "cannot write ") << profileOutputPath << std::endl;
+    }
+
+    // ȵǰ֡դ֮󣺶ϴύͳƣ¶̬Σں޴Ⱦ
+    void prepareFrame() {
+        collectProfile(currentFrame);
+        updateSampleBudget();
+        if (rendererSwitchRequested) {
+            switchRenderer();
+        }
+        if (noiseFrames > 0 && submittedFrames == noiseFrames) {
+            vkDeviceWaitIdle(device);
+            measureNoise();
+        }
+        collectTraversalStats(currentFrame);
+        collectAdaptiveStats(currentFrame);
+        if (dynamicGeometry) {
+            if (instanceCount > 0) {
+                // ʵƶʱײ䣬ֻؽ
+                animateInstances();
+                writeInstanceData(currentFrame);
+            }
+            else {
+                updateDynamicGeometry();
+            }
+        }
+    }
 
+    // ޴ȾȡͼҲֺ͵ȴֱֻ֮ͬ֡ȴդ
+    // ÿﵽ --target-spp --time-limit ӦȫʱдͼƬʱ
+    void renderHeadless() {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count(); };
+        while (true) {
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+            double fenceWait = millisecondsSince(frameStart);
+            prepareFrame();
+            if (adaptiveConverged) break;
+            if (targetSamples > 0 && renderedSamples >= targetSamples) break;
+            if (timeLimit > 0.0f && elapsed() >= timeLimit) break;
+            if (targetSamples > 0) {
+                samplesPerPass = std::min(samplesPerPass, targetSamples - renderedSamples);
+            }
+
+            vkResetFences(device, 1, &inFlightFences[currentFrame]);
+            vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+            recordCommandBuffer(commandBuffers[currentFrame], 0);
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+            submittedFrames++;
+            beginFrameTiming(frameStart, fenceWait, 0.0);
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        }
+        vkDeviceWaitIdle(device);
+        double seconds = elapsed();
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            collectAdaptiveStats(frame);
+        }
+
+        uint64_t pixels = static_cast<uint64_t>(changeImageExtent.width) * changeImageExtent.height;
+        uint64_t paths = adaptiveFrames > 0 ? adaptivePaths : pixels * renderedSamples;
+        std::cout << "headless " << rendererName(renderer) << " render of " << modelPath << " at " << changeImageExtent.width << "x" << changeImageExtent.height
+            << ": " << (double)paths / pixels << " spp in " << submittedFrames << " frames, " << seconds << " s wall time, "
+            << paths / std::max(seconds, 1e-9) * 1e-6 << " Mpaths/s" << std::endl;
+        if (!outputPath.empty()) {
+            saveOutput(outputPath);
+        }
+    }
+
+    // .exr дۻԾֵʱΪչ PNG дɫӳ displayImage
+    void saveOutput(const std::string& path) {
+        uint32_t width = changeImageExtent.width;
+        uint32_t height = changeImageExtent.height;
+        bool ok = false;
+        if (std::filesystem::path(path).extension() == ".exr") {
+            bool denoised = denoise && renderer == RendererType::Wavefront;
+            std::vector<float> accumulated(4ull * width * height);
+            readBackImage(denoised ? wavefront.denoisedImage : changeImage, accumulated.data(), accumulated.size() * sizeof(float));
+            std::vector<float> rgb(3ull * width * height);
+            for (size_t i = 0; i < (size_t)width * height; i++) {
+                float count = std::max(accumulated[4 * i + 3], 1.0f);
+                for (uint32_t c = 0; c < 3; c++) {
+                    rgb[3 * i + c] = accumulated[4 * i + c] / count;
+                }
+            }
+            ok = writeEXR(path, width, height, rgb);
+        }
+        else {
+            std::vector<uint8_t> pixels(4ull * width * height);
+            readBackImage(tonemap.displayImage, pixels.data(), pixels.size());
+            ok = stbi_write_png(path.c_str(), (int)width, (int)height, 4, pixels.data(), (int)(4 * width)) != 0;
+        }
+        std::cout << (ok ? "saved " : "cannot write ") << path << std::endl;
+    }
+
+    // ͼп dstͼ񱣳 GENERAL 
+    void readBackImage(VkImage image, void* dst, VkDeviceSize size) {
+        VkBuffer stagingBuffer;
+        Allocation stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryUsage::Transient);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        VkBufferImageCopy region{};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageExtent = { changeImageExtent.width, changeImageExtent.height, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, stagingBuffer, 1, &region);
+        endSingleTimeCommands(commandBuffer);
+
+        memcpy(dst, stagingBufferMemory.mapped, (size_t)size);
+        destroyBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    void drawFrame() {
+        // ֡ʱ֡ȴդͻȡͼǽʱ䣬GPU ʱʱõ
+        auto frameStart = std::chrono::high_resolution_clock::now();
         vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        double fenceWait = millisecondsSince(frameStart);
+        prepareFrame();
 
         uint32_t imageIndex;
+        auto acquireStart = std::chrono::high_resolution_clock::now();
         VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        double acquire = millisecondsSince(acquireStart);
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             recreateSwapChain();
@@ -1620,7 +6783,7 @@ private:
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
         VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT };
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
@@ -1635,6 +6798,8 @@ private:
         if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        submittedFrames++;
+        beginFrameTiming(frameStart, fenceWait, acquire);
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1744,8 +6909,9 @@ private:
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        // ޴ȾҪûг豸 lavapipe
+        bool swapChainAdequate = headless;
+        if (extensionsSupported && !headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
@@ -1756,6 +6922,11 @@ private:
         return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy&&supportedFeatures.fragmentStoresAndAtomics;
     }
 
+    const std::vector<const char*>& requiredDeviceExtensions() {
+        static const std::vector<const char*> none;
+        return headless ? none : deviceExtensions;
+    }
+
     bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -1763,7 +6934,8 @@ private:
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        const std::vector<const char*>& extensions = requiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
         for (const auto& extension : availableExtensions) {
             requiredExtensions.erase(extension.extensionName);
@@ -1783,12 +6955,19 @@ private:
 
         int i = 0;
         for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            // GPU ļɫҲύͼζ
+            if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
                 indices.graphicsFamily = i;
             }
 
+            // ޴Ⱦֶ֣оͼζ
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            if (headless) {
+                indices.presentFamily = indices.graphicsFamily;
+            }
+            else {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            }
 
             if (presentSupport) {
                 indices.presentFamily = i;
@@ -1806,8 +6985,10 @@ private:
 
     std::vector<const char*> getRequiredExtensions() {
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char** glfwExtensions = nullptr;
+        if (!headless) {
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        }
 
         std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
         if (enableValidationLayers) {
@@ -1867,10 +7048,11 @@ private:
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     HelloTriangleApplication app;
 
     try {
+        app.parseArgs(argc, argv);
         app.run();
     }
     catch (const std::exception& e) {
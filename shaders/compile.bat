@@ -1,3 +1,37 @@
-D:\workSoftware\"Vulkan SDK"\Bin\glslangValidator.exe -V shader.vert
-D:\workSoftware\"Vulkan SDK"\Bin\glslangValidator.exe -V shader.frag
-pause
+@echo off
+rem SPIR-V is not tracked in git: VulkanLearn.vcxproj runs this script before every build.
+cd /d "%~dp0"
+set GLSLANG=D:\workSoftware\Vulkan SDK\Bin\glslangValidator.exe
+if defined VULKAN_SDK set GLSLANG=%VULKAN_SDK%\Bin\glslangValidator.exe
+"%GLSLANG%" -V shader.vert || goto :error
+"%GLSLANG%" -V shader.frag || goto :error
+"%GLSLANG%" -V lbvh_scene_bounds.comp -o lbvh_scene_bounds.spv || goto :error
+"%GLSLANG%" -V lbvh_morton.comp -o lbvh_morton.spv || goto :error
+"%GLSLANG%" -V radix_histogram.comp -o radix_histogram.spv || goto :error
+"%GLSLANG%" -V radix_scatter.comp -o radix_scatter.spv || goto :error
+"%GLSLANG%" -V scan_block.comp -o scan_block.spv || goto :error
+"%GLSLANG%" -V scan_add.comp -o scan_add.spv || goto :error
+"%GLSLANG%" -V lbvh_leaves.comp -o lbvh_leaves.spv || goto :error
+"%GLSLANG%" -V lbvh_hierarchy.comp -o lbvh_hierarchy.spv || goto :error
+"%GLSLANG%" -V lbvh_refit.comp -o lbvh_refit.spv || goto :error
+"%GLSLANG%" -V ploc_nearest.comp -o ploc_nearest.spv || goto :error
+"%GLSLANG%" -V ploc_merge.comp -o ploc_merge.spv || goto :error
+"%GLSLANG%" -V ploc_compact.comp -o ploc_compact.spv || goto :error
+"%GLSLANG%" -V refit_transform.comp -o refit_transform.spv || goto :error
+"%GLSLANG%" -V refit_nodes.comp -o refit_nodes.spv || goto :error
+"%GLSLANG%" -V wavefront_schedule.comp -o wavefront_schedule.spv || goto :error
+"%GLSLANG%" -V wavefront_generate.comp -o wavefront_generate.spv || goto :error
+"%GLSLANG%" -V wavefront_dispatch.comp -o wavefront_dispatch.spv || goto :error
+"%GLSLANG%" -V wavefront_extend.comp -o wavefront_extend.spv || goto :error
+"%GLSLANG%" -V wavefront_shade.comp -o wavefront_shade.spv || goto :error
+"%GLSLANG%" -V wavefront_connect.comp -o wavefront_connect.spv || goto :error
+"%GLSLANG%" -V wavefront_accumulate.comp -o wavefront_accumulate.spv || goto :error
+"%GLSLANG%" -V wavefront_denoise_prepare.comp -o wavefront_denoise_prepare.spv || goto :error
+"%GLSLANG%" -V wavefront_denoise_atrous.comp -o wavefront_denoise_atrous.spv || goto :error
+"%GLSLANG%" -V tonemap.comp -o tonemap.spv || goto :error
+if not "%1"=="nopause" pause
+exit /b 0
+
+:error
+if not "%1"=="nopause" pause
+exit /b 1
@@ -0,0 +1,123 @@
+// GPU 建树各阶段共用的资源声明，与 main.cpp 中的 BVHBuildConstants 和 buildSetLayout 对应
+
+#define WORKGROUP_SIZE 256
+
+struct vertex {
+    vec3 pos;
+    vec3 color;
+    bool emissive;
+    float roughness;
+};
+
+struct BVHNode {
+    int left, right;    // 左右子树索引
+    int n, index;       // 叶子节点信息
+    vec3 AA;
+    int parent;         // 父节点，根为 -1
+    vec3 BB;            // 碰撞盒
+};
+
+struct TrianglePositions {
+    vec3 p0;
+    vec3 p1;
+    vec3 p2;
+};
+
+struct TriangleShading {
+    vec3 color;
+    float roughness;
+    uint emissive;
+    uint primitive;
+};
+
+layout(push_constant) uniform BuildConstants {
+    uint count;         // 本次派发要处理的元素数
+    uint shift;         // 基数排序当前处理的位
+    uint srcOffset;     // 乒乓缓冲的读、写偏移
+    uint dstOffset;
+    uint scanOffset;    // 前缀和数据段的偏移
+    uint sumsOffset;    // 前缀和块和段的偏移
+    uint groupCount;    // 有效工作组数，二维派发时多出来的组直接返回
+    uint radius;        // PLOC 搜索半径
+    uint leafCount;     // 三角形数
+};
+
+layout(binding = 0) readonly buffer vertexBuffer {
+    vertex vertices[];
+};
+layout(binding = 1) readonly buffer indexBuffer {
+    uint indices[];
+};
+layout(binding = 2) buffer triangleBuffer {
+    uint triangles[];
+};
+layout(binding = 3) coherent buffer BVHBuffer {
+    BVHNode BVHNodes[];
+};
+layout(binding = 4) buffer keyBuffer {
+    uint keys[];
+};
+layout(binding = 5) buffer valueBuffer {
+    uint values[];
+};
+layout(binding = 6) buffer scanBuffer {
+    uint scan[];
+};
+layout(binding = 7) buffer parentBuffer {
+    int parents[];
+};
+layout(binding = 8) coherent buffer flagBuffer {
+    uint flags[];
+};
+layout(binding = 9) buffer clusterBuffer {
+    int clusters[];     // [0, leafCount): 当前的簇，[leafCount, 2*leafCount): 合并后的簇
+};
+layout(binding = 10) buffer neighbourBuffer {
+    int neighbours[];
+};
+layout(binding = 11) coherent buffer globalBuffer {
+    uint sceneMin[3];   // 质心包围盒，按可比较的无符号整数存放
+    uint sceneMax[3];
+    uint allocated;     // PLOC 已分配的内部节点数
+    uint clusterCount;  // PLOC 剩余的簇数
+};
+layout(binding = 12) writeonly buffer trianglePositionBuffer {
+    TrianglePositions trianglePositions[];
+};
+layout(binding = 13) writeonly buffer triangleShadingBuffer {
+    TriangleShading triangleShading[];
+};
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+// 工作组数超过 65535 时按二维派发
+uint workgroupIndex() {
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+uint invocationIndex() {
+    return workgroupIndex() * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+// 浮点数映射为保序的无符号整数，用于 atomicMin/atomicMax
+uint floatToOrdered(float f) {
+    uint u = floatBitsToUint(f);
+    return (u & 0x80000000u) != 0u ? ~u : (u | 0x80000000u);
+}
+
+float orderedToFloat(uint u) {
+    return uintBitsToFloat((u & 0x80000000u) != 0u ? (u & 0x7fffffffu) : ~u);
+}
+
+vec3 trianglePoint(uint t, uint k) {
+    return vertices[indices[3u * t + k]].pos;
+}
+
+vec3 triangleCentroid(uint t) {
+    return (trianglePoint(t, 0u) + trianglePoint(t, 1u) + trianglePoint(t, 2u)) / 3.0;
+}
+
+float surfaceArea(vec3 AA, vec3 BB) {
+    vec3 len = max(BB - AA, vec3(0.0));
+    return 2.0 * (len.x * len.y + len.x * len.z + len.y * len.z);
+}
@@ -0,0 +1,101 @@
+// 材质：Lambert 漫反射和 GGX 镜面两个波瓣，按 roughness 混合，需在 scene_common.glsl 之后包含
+// roughness 沿用原来的含义：1 为纯漫反射，越小镜面成分越多；同时作为 GGX 的粗糙度，alpha = roughness^2
+// 方向都在世界空间，wo 指向观察者，wi 指向下一段光线；随机数由调用者传入
+
+// 以 N 为 z 轴的正交基，列依次为切线、副切线、法线
+mat3 shadingFrame(vec3 N) {
+    vec3 helper = abs(N.x) > 0.999 ? vec3(0, 0, 1) : vec3(1, 0, 0);
+    vec3 tangent = normalize(cross(N, helper));
+    vec3 bitangent = cross(N, tangent);
+    return mat3(tangent, bitangent, N);
+}
+
+// 选中漫反射波瓣的概率，也是它在 BSDF 中的权重
+float diffuseWeight(HitResult res) {
+    return res.roughness;
+}
+
+// alpha 过小时 D 在浮点下溢出，按接近镜面处理
+float ggxAlpha(HitResult res) {
+    return max(res.roughness * res.roughness, 1e-3);
+}
+
+float ggxD(float NoH, float alpha) {
+    float a2 = alpha * alpha;
+    float d = NoH * NoH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+// Smith 遮挡项
+float ggxG1(float NoV, float alpha) {
+    float a2 = alpha * alpha;
+    return 2.0 * NoV / (NoV + sqrt(a2 + (1.0 - a2) * NoV * NoV));
+}
+
+// 镜面颜色取反照率，相当于金属
+vec3 fresnelSchlick(vec3 F0, float VoH) {
+    return F0 + (1.0 - F0) * pow(1.0 - clamp(VoH, 0.0, 1.0), 5.0);
+}
+
+// 可见法线分布采样（Heitz 2018），V 和返回的半程向量都在以法线为 z 轴的局部空间
+vec3 sampleGGXVNDF(vec3 V, float alpha, float u1, float u2) {
+    vec3 Vh = normalize(vec3(alpha * V.x, alpha * V.y, V.z));
+    float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+    vec3 T1 = lensq > 0.0 ? vec3(-Vh.y, Vh.x, 0.0) * inversesqrt(lensq) : vec3(1.0, 0.0, 0.0);
+    vec3 T2 = cross(Vh, T1);
+    float r = sqrt(u1);
+    float phi = 2.0 * PI * u2;
+    float t1 = r * cos(phi);
+    float t2 = r * sin(phi);
+    float s = 0.5 * (1.0 + Vh.z);
+    t2 = (1.0 - s) * sqrt(1.0 - t1 * t1) + s * t2;
+    vec3 Nh = t1 * T1 + t2 * T2 + sqrt(max(0.0, 1.0 - t1 * t1 - t2 * t2)) * Vh;
+    return normalize(vec3(alpha * Nh.x, alpha * Nh.y, max(0.0, Nh.z)));
+}
+
+// BSDF 的值，不含余弦项
+vec3 evalBSDF(HitResult res, vec3 wo, vec3 wi) {
+    float NoV = dot(res.normal, wo);
+    float NoL = dot(res.normal, wi);
+    if (NoV <= 0.0 || NoL <= 0.0) return vec3(0);
+    vec3 f = diffuseWeight(res) * res.color / PI;
+    float specular = 1.0 - diffuseWeight(res);
+    if (specular > 0.0) {
+        vec3 H = normalize(wo + wi);
+        float alpha = ggxAlpha(res);
+        float D = ggxD(dot(res.normal, H), alpha);
+        float G = ggxG1(NoV, alpha) * ggxG1(NoL, alpha);
+        f += specular * fresnelSchlick(res.color, dot(wo, H)) * D * G / (4.0 * NoV * NoL);
+    }
+    return f;
+}
+
+// 两个波瓣按选择概率混合后的方向概率密度，与 sampleBSDF 一致
+float pdfBSDF(HitResult res, vec3 wo, vec3 wi) {
+    float NoV = dot(res.normal, wo);
+    float NoL = dot(res.normal, wi);
+    if (NoV <= 0.0 || NoL <= 0.0) return 0.0;
+    float pdf = diffuseWeight(res) * NoL / PI;
+    float specular = 1.0 - diffuseWeight(res);
+    if (specular > 0.0) {
+        vec3 H = normalize(wo + wi);
+        float alpha = ggxAlpha(res);
+        // 可见法线的密度 G1(wo) D(H) max(0, wo.H) / NoV，经反射的雅可比 1 / (4 wo.H) 换到 wi
+        pdf += specular * ggxG1(NoV, alpha) * ggxD(dot(res.normal, H), alpha) / (4.0 * NoV);
+    }
+    return pdf;
+}
+
+// u.x 选择波瓣：漫反射按余弦采样，镜面按可见法线采样半程向量后反射；方向落到表面以下时返回 false
+bool sampleBSDF(HitResult res, vec3 wo, vec3 u, out vec3 wi) {
+    mat3 frame = shadingFrame(res.normal);
+    if (u.x < diffuseWeight(res)) {
+        float r = sqrt(u.y);
+        float phi = 2.0 * PI * u.z;
+        wi = frame * vec3(r * cos(phi), r * sin(phi), sqrt(max(0.0, 1.0 - u.y)));
+    } else {
+        vec3 H = frame * sampleGGXVNDF(wo * frame, ggxAlpha(res), u.y, u.z);
+        wi = reflect(-wo, H);
+    }
+    return dot(wi, res.normal) > 0.0;
+}
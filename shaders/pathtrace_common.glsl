@@ -0,0 +1,154 @@
+// 片段着色器和波前计算着色器共用的随机数、相机、材质采样和光源采样，需在 scene_common.glsl 之后包含
+
+#include "material.glsl"
+
+uint seed;
+
+// 与像素和帧号相关的初始种子；按整数像素坐标计算，任意分辨率下相邻像素的种子都不同
+uint initSeed(uvec2 pixel, uint frame) {
+    return uint(
+        pixel.x * uint(1973) + 
+        pixel.y * uint(9277) + 
+        frame * uint(26699)) | uint(1);
+}
+
+uint wang_hash(inout uint seed) {
+    seed = uint(seed ^ uint(61)) ^ uint(seed >> uint(16));
+    seed *= uint(9);
+    seed = seed ^ (seed >> 4);
+    seed *= uint(0x27d4eb2d);
+    seed = seed ^ (seed >> 15);
+    return seed;
+}
+
+// 同一像素同一帧的第 sampleIndex 条路径；再散列一次，不同序号的序列之间没有简单的偏移关系
+uint sampleSeed(uvec2 pixel, uint frame, uint sampleIndex) {
+    uint s = initSeed(pixel, frame) ^ (sampleIndex * 0x9E3779B9u);
+    return wang_hash(s) | 1u;
+}
+
+float rand() {
+    return float(wang_hash(seed)) / 4294967296.0;
+}
+// pix 为 [-1, 1] 的屏幕坐标，y 向上；像素内随机抖动，范围为半个像素，resolution 为渲染分辨率
+Ray cameraRay(vec2 pix, vec2 resolution) {
+    Ray ray;
+    ray.startPoint = vec3(0, 0, 2);
+    vec2 jitter = (vec2(rand(), rand()) - 0.5) / resolution;
+    vec3 dir = vec3(pix.x+jitter.x,pix.y+jitter.y,1)-ray.startPoint;
+    ray.direction = normalize(dir);
+    return ray;
+}
+
+// 在交点处按材质采样下一段光线，history 乘上 f * cos / pdf；返回所选方向的概率密度，为 0 时路径结束
+float scatter(inout Ray ray, HitResult res, inout vec3 history) {
+    vec3 wo = -ray.direction;
+    vec3 wi;
+    float pdf = 0.0;
+    if (sampleBSDF(res, wo, vec3(rand(), rand(), rand()), wi)) pdf = pdfBSDF(res, wo, wi);
+    if (pdf > 0.0) history *= evalBSDF(res, wo, wi) * dot(wi, res.normal) / pdf;
+    ray.startPoint = res.hitPoint;
+    ray.direction = wi;
+    return pdf;
+}
+
+// 俄罗斯轮盘赌：前 rouletteDepth 段不终止，之后按 throughput 的最大分量决定是否继续，
+// 存活的路径除以存活概率，结果仍然无偏；minProbability 限制存活路径的权重
+bool survivesRoulette(int depth, int rouletteDepth, float minProbability, inout vec3 throughput) {
+    if (depth < rouletteDepth) return true;
+    float p = clamp(max(throughput.x, max(throughput.y, throughput.z)), minProbability, 1.0);
+    if (rand() >= p) return false;
+    throughput /= p;
+    return true;
+}
+
+// 累积状态的另外两部分，两条路径的绑定编号相同：Kahan 求和的补偿项，以及 32 位无符号整数的样本数
+// changeImage 的 rgb 为样本之和，a 只是样本数的浮点副本，供色调映射和读回求均值
+layout(binding = 19, rgba32f) uniform image2D compensationImage;
+layout(binding = 20, r32ui) uniform uimage2D sampleCountImage;
+
+// 把 count 个样本之和 sum 加到像素的累积和 accumulatedSum 上，补偿项和样本数在这里读写，返回写入 changeImage 的值；
+// 补偿求和使 float 的和在样本很多时仍能吸收新样本。maxAccumulation > 0 时先按比例缩小旧的和，
+// 使加入新样本后总数不超过它；否则样本数到 uint 的上限时同样处理，不会回绕
+vec4 accumulateSamples(ivec2 pixel, vec3 accumulatedSum, vec3 sum, uint count, int maxAccumulation) {
+    vec3 compensation = imageLoad(compensationImage, pixel).rgb;
+    uint accumulatedCount = imageLoad(sampleCountImage, pixel).r;
+    uint limit = maxAccumulation > 0 ? uint(maxAccumulation) : 0xFFFFFFFFu;
+    uint keep = limit - min(count, limit);
+    if (accumulatedCount > keep) {
+        float scale = float(keep) / float(accumulatedCount);
+        accumulatedSum *= scale;
+        compensation *= scale;
+        accumulatedCount = keep;
+    }
+    // precise 禁止编译器按代数化简掉补偿项
+    precise vec3 y = sum - compensation;
+    precise vec3 t = accumulatedSum + y;
+    precise vec3 error = (t - accumulatedSum) - y;
+    accumulatedCount += count;
+    imageStore(compensationImage, pixel, vec4(error, 0.0));
+    imageStore(sampleCountImage, pixel, uvec4(accumulatedCount));
+    return vec4(t, float(accumulatedCount));
+}
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float powerHeuristic(float a, float b) {
+    return a * a / (a * a + b * b);
+}
+
+bool sampleLights() {
+    return NEXT_EVENT && emissiveCount > 0u;
+}
+
+// 光源采样选中某个方向的立体角概率密度：选中三角形的概率除以面积恰好是 亮度 / emissivePower，与面积无关
+float lightPdf(vec3 emission, float dist, float cosLight) {
+    return luminance(emission) / emissivePower * dist * dist / max(cosLight, 1e-6);
+}
+
+// BSDF 采样的光线命中光源时的 MIS 权重，bsdfPdf 为上一个交点采样这个方向的概率密度；
+// 上一个交点没有做光源采样时传入 0，光源只能由 BSDF 采样得到，权重为 1
+float emissionWeight(HitResult res, float bsdfPdf) {
+    if (bsdfPdf <= 0.0) return 1.0;
+    float cosLight = abs(dot(res.normal, res.viewDir));
+    return powerHeuristic(bsdfPdf, lightPdf(res.color, res.distance, cosLight));
+}
+
+// 阴影光线的终点离光源留一点距离，不把光源本身当作遮挡
+#define SHADOW_OFFSET 0.001
+
+// 次事件估计的采样结果，contribution 为未乘 history 的 MIS 加权贡献
+struct LightSample {
+    Ray shadow;
+    float distance;
+    vec3 contribution;
+};
+
+// 用别名表选一个发光三角形并在其上均匀取点；返回 false 表示这个样本没有贡献，不必发射阴影光线
+bool sampleDirectLight(HitResult res, out LightSample s) {
+    float u = rand() * float(emissiveCount);
+    uint k = min(uint(u), emissiveCount - 1u);
+    EmissiveTriangle light = emissiveTriangles[k];
+    if (fract(u) >= light.threshold) light = emissiveTriangles[light.alias];
+
+    float r = sqrt(rand());
+    float v = rand();
+    vec3 y = light.p0 * (1.0 - r) + light.p1 * (r * (1.0 - v)) + light.p2 * (r * v);
+    vec3 L = y - res.hitPoint;
+    float dist = length(L);
+    vec3 wi = L / dist;
+    float cosSurface = dot(wi, res.normal);
+    // 光源双面发光，与 resolveHit 中从背面击中的处理一致
+    float cosLight = abs(dot(normalize(cross(light.p1 - light.p0, light.p2 - light.p0)), wi));
+    if (cosSurface <= 0.0 || cosLight <= 0.0) return false;
+
+    vec3 wo = -res.viewDir;
+    float pdf = lightPdf(light.emission, dist, cosLight);
+    s.shadow.startPoint = res.hitPoint;
+    s.shadow.direction = wi;
+    s.distance = dist - SHADOW_OFFSET;
+    s.contribution = evalBSDF(res, wo, wi) * cosSurface * light.emission * powerHeuristic(pdf, pdfBSDF(res, wo, wi)) / pdf;
+    return true;
+}
@@ -0,0 +1,7 @@
+// 4 位基数排序，每个工作组处理一个 TILE_SIZE 大小的分块
+
+#define RADIX_BITS 4u
+#define RADIX_SIZE 16u
+#define RADIX_MASK 15u
+#define ITEMS_PER_THREAD 4u
+#define TILE_SIZE (WORKGROUP_SIZE * ITEMS_PER_THREAD)
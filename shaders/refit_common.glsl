@@ -0,0 +1,67 @@
+// 动态几何每帧重算共用的资源声明，与 main.cpp 中的 RefitConstants 和 createDynamicRefit 对应
+
+#define WORKGROUP_SIZE 256
+
+struct vertex {
+    vec3 pos;
+    vec3 color;
+    bool emissive;
+    float roughness;
+};
+
+struct BVHNode {
+    int left, right;    // 左右子树索引，0 表示没有
+    int n, index;       // 叶子节点信息
+    vec3 AA;
+    int parent;         // 父节点，根为 -1；重算碰撞盒时不变
+    vec3 BB;            // 碰撞盒
+};
+
+struct TrianglePositions {
+    vec3 p0;
+    vec3 p1;
+    vec3 p2;
+};
+
+layout(push_constant) uniform RefitConstants {
+    mat4 model;                 // 模型三角形的变换
+    uint triangleCount;
+    uint dynamicTriangleCount;  // 原始编号小于它的三角形属于模型，其余为静态场景
+    uint leafCount;
+    uint groupCount;            // 有效工作组数，二维派发时多出来的组直接返回
+};
+
+layout(binding = 0) readonly buffer vertexBuffer {
+    vertex vertices[];          // 静止姿态
+};
+layout(binding = 1) readonly buffer indexBuffer {
+    uint indices[];
+};
+layout(binding = 2) readonly buffer triangleBuffer {
+    uint triangles[];
+};
+layout(binding = 3) coherent buffer BVHBuffer {
+    BVHNode BVHNodes[];
+};
+layout(binding = 4) buffer trianglePositionBuffer {
+    TrianglePositions trianglePositions[];
+};
+layout(binding = 5) readonly buffer parentBuffer {
+    int parents[];              // 根节点为 -1
+};
+layout(binding = 6) readonly buffer leafBuffer {
+    int leaves[];
+};
+layout(binding = 7) coherent buffer flagBuffer {
+    uint flags[];
+};
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+uint workgroupIndex() {
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+uint invocationIndex() {
+    return workgroupIndex() * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
@@ -0,0 +1,593 @@
+// 片段着色器和波前计算着色器共用的场景数据与 BVH 遍历
+// 绑定编号在两条路径中相同：0/1 三角形，2 发光三角形，3 二叉树，5 多叉树，6 统计，7/8 实例和顶层树
+
+// BVH 宽度：2 为二叉树，4/8 为折叠后的多叉树
+layout(constant_id = 0) const int BVH_WIDTH = 2;
+// 统计每条光线的节点读取、包围盒和三角形求交次数
+layout(constant_id = 1) const bool BVH_STATS = false;
+// 两级结构：先遍历实例的顶层树，再在物体空间中遍历网格的底层树
+layout(constant_id = 2) const bool INSTANCING = false;
+// 短栈并按最近交点剔除；false 时整个栈放在局部内存且不剔除，用于对比遍历统计
+layout(constant_id = 3) const bool SHORT_STACK = true;
+// 次事件估计：每个漫反射交点向发光三角形发射阴影光线，与 BSDF 采样按 MIS 合并
+layout(constant_id = 4) const bool NEXT_EVENT = true;
+// 遍历栈的容量，即 main.cpp 的 TRAVERSAL_STACK_SIZE；溢出的光线改走 traverseStackless
+layout(constant_id = 5) const int TRAVERSAL_STACK_SIZE = 128;
+// 顶层树遍历栈的容量，主机端按实例数算出，足够装下中位数二分的顶层树
+layout(constant_id = 6) const int TLAS_STACK_SIZE = 32;
+
+#define MAX_BVH_WIDTH 8
+
+#define PI 3.1415926535
+
+// 按叶子顺序预取的三角形，第 i 项对应叶子中的第 i 个三角形
+struct TrianglePositions {
+    vec3 p0;
+    vec3 p1;
+    vec3 p2;
+};
+
+// 着色属性，只在确定最近交点后读取
+struct TriangleShading {
+    vec3 color;
+    float roughness;
+    uint emissive;
+    uint primitive;
+};
+
+struct BVHNode {
+    int left, right;    
+    int n, index;      
+    vec3 AA;
+    int parent;         // 父节点，根为 -1，只在遍历栈溢出时使用
+    vec3 BB;       
+};
+
+// 实例：两个方向的变换和网格底层树的根节点
+struct Instance {
+    mat4 worldToObject;
+    mat4 objectToWorld;
+    int root;
+    int mesh;
+};
+
+// 多叉树节点的一个子节点，count>0: 叶子；count==0: 内部节点；count<0: 空位
+struct WideChild {
+    vec3 AA;
+    int child;
+    vec3 BB;
+    int count;
+};
+
+layout(binding = 0) readonly buffer trianglePositionBuffer {
+    TrianglePositions trianglePositions[];
+};
+layout(binding = 1) readonly buffer triangleShadingBuffer {
+    TriangleShading triangleShading[];
+};
+// 发光三角形的别名表，与 main.cpp 中的 EmissiveTriangle 对应，不受建树重排的影响
+struct EmissiveTriangle {
+    vec3 p0;
+    float threshold;    // 随机数小于 threshold 时选中自己，否则选中 alias
+    vec3 p1;
+    uint alias;
+    vec3 p2;
+    float pad0;
+    vec3 emission;
+    float pad1;
+};
+layout(binding = 2) readonly buffer LightBuffer {
+    uint emissiveCount;
+    float emissivePower;    // 所有发光三角形的 面积 x 亮度 之和
+    EmissiveTriangle emissiveTriangles[];
+};
+layout(binding = 3) buffer BVHBuffer {
+    BVHNode BVHNodes[]; 
+};
+layout(binding = 5) buffer WideBVHBuffer {
+    WideChild wideNodes[];
+};
+layout(binding = 6) buffer StatsBuffer {
+    uint statRays;
+    uint statNodeFetches;
+    uint statBoxTests;
+    uint statTriangleTests;
+    uint statStackTraffic;      // 溢出栈的读写次数，不含环形缓冲的访问
+    uint statCulledNodes;       // 出栈时因进入距离超过最近交点而跳过的节点
+};
+layout(binding = 7) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+layout(binding = 8) readonly buffer TLASBuffer {
+    BVHNode tlasNodes[];
+};
+
+uint nodeFetches = 0;
+uint boxTests = 0;
+uint triangleTests = 0;
+uint stackTraffic = 0;
+uint culledNodes = 0;
+
+struct Ray {
+    vec3 startPoint;
+    vec3 direction;
+};
+
+struct HitResult {
+    bool isHit;             
+    bool isInside;//内部击中
+    float distance;
+    vec3 hitPoint;
+    vec3 normal;
+    vec3 viewDir;//击中此点的光线方向          
+    vec3 color;
+    bool emissive;
+    float roughness;
+    vec2 barycentric;       // 交点相对 p1、p2 的重心坐标
+};
+
+// 遍历只求出最近交点，着色属性在之后由 resolveHit 读取
+struct ClosestHit {
+    float distance;
+    int index;          // 叶子顺序的三角形下标，-1 表示未命中
+    int instance;       // 两级结构中命中的实例，单层时为 -1
+    vec2 barycentric;
+};
+
+#define TRIANGLE_T_MIN 0.0005
+
+// 水密求交（Woop 等人的方法）中每条光线只算一次的部分：
+// kz 为方向绝对值最大的轴，剪切后光线沿 +z，三角形投影到 xy 平面上判断
+struct TriangleRay {
+    vec3 origin;
+    ivec3 axes;         // kx, ky, kz
+    vec3 shear;         // Sx, Sy, Sz
+};
+
+TriangleRay setupTriangleRay(Ray ray) {
+    vec3 d = abs(ray.direction);
+    int kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    // 保持三角形的环绕方向，使边函数的符号含义不变
+    if (ray.direction[kz] < 0.0) {
+        int k = kx;
+        kx = ky;
+        ky = k;
+    }
+    TriangleRay r;
+    r.origin = ray.startPoint;
+    r.axes = ivec3(kx, ky, kz);
+    float invZ = 1.0 / ray.direction[kz];
+    r.shear = vec3(ray.direction[kx] * invZ, ray.direction[ky] * invZ, invZ);
+    return r;
+}
+
+// 光线和三角形求交，循环内只做剪切和三个边函数，没有除法；
+// 公共边的边函数只取决于两个公共顶点，相邻三角形算出的值逐位相同，光线不会从缝里漏过去
+// 只有比 closest 更近的交点才除一次行列式，得到距离和重心坐标
+bool hitTriangle(int i, TriangleRay r, float closest, out float t, out vec2 barycentric) {
+    TrianglePositions tri = trianglePositions[i];
+    vec3 A = tri.p0 - r.origin;
+    vec3 B = tri.p1 - r.origin;
+    vec3 C = tri.p2 - r.origin;
+    A = vec3(A[r.axes.x], A[r.axes.y], A[r.axes.z]);
+    B = vec3(B[r.axes.x], B[r.axes.y], B[r.axes.z]);
+    C = vec3(C[r.axes.x], C[r.axes.y], C[r.axes.z]);
+
+    float Ax = A.x - r.shear.x * A.z;
+    float Ay = A.y - r.shear.y * A.z;
+    float Bx = B.x - r.shear.x * B.z;
+    float By = B.y - r.shear.y * B.z;
+    float Cx = C.x - r.shear.x * C.z;
+    float Cy = C.y - r.shear.y * C.z;
+
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+    // 边函数异号说明交点在三角形外；全为 0 是平行光线或退化三角形
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0)) return false;
+    float det = U + V + W;
+    if (det == 0.0) return false;
+
+    // 距离的范围检查两边同乘行列式，省掉除法
+    float T = (U * A.z + V * B.z + W * C.z) * r.shear.z;
+    float absDet = abs(det);
+    float signedT = det < 0.0 ? -T : T;
+    if (signedT < TRIANGLE_T_MIN * absDet || signedT >= closest * absDet) return false;
+
+    float invDet = 1.0 / det;
+    t = T * invDet;
+    barycentric = vec2(V, W) * invDet;
+    return true;
+}
+
+// 在叶子 [l, r] 中更新最近交点；anyHit 时找到第一个交点就返回
+void hitArray(TriangleRay ray, int l, int r, bool anyHit, inout float closest, inout int closestIndex, inout vec2 closestBarycentric) {
+    if (BVH_STATS) triangleTests += uint(r - l + 1);
+    for(int i=l; i<=r; i++) {
+        float t;
+        vec2 barycentric;
+        if (hitTriangle(i, ray, closest, t, barycentric)) {
+            closest = t;
+            closestIndex = i;
+            closestBarycentric = barycentric;
+            if (anyHit) return;
+        }
+    }
+}
+
+// 遍历结束后才读取最近三角形的法线和着色属性；实例的三角形边先变换到世界空间
+HitResult resolveHit(Ray ray, ClosestHit hit) {
+    int i = hit.index;
+    float t = hit.distance;
+    HitResult res;
+    res.isHit = false;
+    res.isInside = false;
+    res.emissive = false;
+    res.distance = 100;
+    if (i < 0) return res;
+
+    TrianglePositions tri = trianglePositions[i];
+    TriangleShading shading = triangleShading[i];
+
+    mat3 toWorld = INSTANCING && hit.instance >= 0 ? mat3(instances[hit.instance].objectToWorld) : mat3(1.0);
+    vec3 N = normalize(cross(toWorld * (tri.p1 - tri.p0), toWorld * (tri.p2 - tri.p0)));    // 法向量
+    // 从三角形背后（模型内部）击中
+    if (dot(N, ray.direction) > 0.0f) {
+        N = -N;
+        res.isInside = true;
+    }
+
+    res.isHit = true;
+    res.distance = t;
+    res.hitPoint = ray.startPoint + ray.direction * t;
+    res.normal = N;
+    res.viewDir = ray.direction;
+    res.color = shading.color;
+    res.emissive = shading.emissive != 0u;
+    res.roughness = shading.roughness;
+    res.barycentric = hit.barycentric;
+    return res;
+}
+
+// 光线与包围盒求交，invDir 和 originScaled 每条光线只算一次
+// 返回进入距离（起点在盒内时为 0），未命中或进入距离超过 limit 时返回 -1
+float slabEntry(vec3 AA, vec3 BB, vec3 invDir, vec3 originScaled, float limit){
+    vec3 t0 = AA * invDir - originScaled;
+    vec3 t1 = BB * invDir - originScaled;
+    vec3 tmin = min(t0, t1);
+    vec3 tmax = max(t0, t1);
+    float enter = max(max(tmin.x, tmin.y), max(tmin.z, 0.0));
+    float exit = min(min(tmax.x, tmax.y), min(tmax.z, limit));
+    return enter <= exit ? enter : -1.0;
+}
+
+// 剔除用的距离上限；整栈模式下不剔除，作为统计对比的基准
+float cullDistance(float closest) {
+    return SHORT_STACK ? closest : 1e30;
+}
+
+// 遍历栈：最近入栈的 SHORT_STACK_SIZE 项放在一个小的环形缓冲里，
+// 更早的项挪到溢出栈，只有树很深时才会读写溢出栈；
+// 溢出栈单独就能装下 TRAVERSAL_STACK_SIZE 项，整栈模式的容量与短栈模式相同；
+// 溢出栈也满了就记下 stackOverflow，本次遍历提前结束，再从根开始无栈遍历
+#define SHORT_STACK_SIZE 8
+#define SPILL_STACK_SIZE TRAVERSAL_STACK_SIZE
+
+int shortStackNodes[SHORT_STACK_SIZE];
+float shortStackDist[SHORT_STACK_SIZE];
+int spillStackNodes[SPILL_STACK_SIZE];
+float spillStackDist[SPILL_STACK_SIZE];
+int shortBase;
+int shortCount;
+int spillCount;
+bool stackOverflow;
+
+void stackReset() {
+    shortBase = 0;
+    shortCount = 0;
+    spillCount = 0;
+    stackOverflow = false;
+}
+
+void spillPush(int node, float dist) {
+    if (BVH_STATS) stackTraffic++;
+    if (spillCount == SPILL_STACK_SIZE) {
+        stackOverflow = true;
+        return;
+    }
+    spillStackNodes[spillCount] = node;
+    spillStackDist[spillCount] = dist;
+    spillCount++;
+}
+
+void stackPush(int node, float dist) {
+    if (!SHORT_STACK) {
+        spillPush(node, dist);
+        return;
+    }
+    if (shortCount == SHORT_STACK_SIZE) {
+        // 最早入栈的一项最后才会出栈，把它挪到局部内存
+        spillPush(shortStackNodes[shortBase], shortStackDist[shortBase]);
+        shortBase = (shortBase + 1) & (SHORT_STACK_SIZE - 1);
+        shortCount--;
+    }
+    int slot = (shortBase + shortCount) & (SHORT_STACK_SIZE - 1);
+    shortStackNodes[slot] = node;
+    shortStackDist[slot] = dist;
+    shortCount++;
+}
+
+// 弹出下一个进入距离小于 closest 的节点，更远的直接丢弃；栈空或已经溢出时返回 false
+bool stackPop(float closest, out int node) {
+    node = -1;
+    if (stackOverflow) return false;
+    while (true) {
+        float dist;
+        if (shortCount > 0) {
+            shortCount--;
+            int slot = (shortBase + shortCount) & (SHORT_STACK_SIZE - 1);
+            node = shortStackNodes[slot];
+            dist = shortStackDist[slot];
+        } else if (spillCount > 0) {
+            spillCount--;
+            node = spillStackNodes[spillCount];
+            dist = spillStackDist[spillCount];
+            if (BVH_STATS) stackTraffic++;
+        } else {
+            return false;
+        }
+        if (dist < cullDistance(closest)) return true;
+        if (BVH_STATS) culledNodes++;
+    }
+    return false;
+}
+
+// 遍历栈溢出后的退路：从 root 开始沿父节点回溯的无栈遍历（Hapala 等人 2011），固定先左后右，
+// 已经找到的交点继续用于剔除，重复访问的三角形不会替换距离相同的交点
+void traverseStackless(int root, TriangleRay triangleRay, vec3 invDir, vec3 originScaled, bool anyHit,
+    inout float closest, inout int closestIndex, inout vec2 barycentric){
+    int node = root;
+    bool descend = true;    // true：刚到达 node；false：node 的子树已经处理完
+    while(true){
+        if(descend){
+            BVHNode current = BVHNodes[node];
+            if (BVH_STATS) { nodeFetches++; boxTests++; }
+            if (slabEntry(current.AA, current.BB, invDir, originScaled, cullDistance(closest)) >= 0) {
+                if(current.n>0){
+                    hitArray(triangleRay, current.index, current.index + current.n - 1, anyHit, closest, closestIndex, barycentric);
+                    if (anyHit && closestIndex >= 0) return;
+                } else if(current.left>0 || current.right>0) {
+                    node = current.left>0 ? current.left : current.right;
+                    continue;
+                }
+            }
+            descend = false;
+        }
+        // 左子树处理完后转到右兄弟，否则回到父节点
+        if (node == root) return;
+        int parent = BVHNodes[node].parent;
+        BVHNode parentNode = BVHNodes[parent];
+        if (BVH_STATS) nodeFetches += 2u;
+        if (node == parentNode.left && parentNode.right > 0) {
+            node = parentNode.right;
+            descend = true;
+        } else {
+            node = parent;
+        }
+    }
+}
+
+// 一次读取整个节点，测试所有子节点的包围盒后按距离由近到远访问
+ClosestHit traceWideBVH(Ray ray, float tMax, bool anyHit){
+    float closest = tMax;
+    int closestIndex = -1;
+    vec2 barycentric = vec2(0.0);
+    TriangleRay triangleRay = setupTriangleRay(ray);
+    vec3 invDir = 1.0 / ray.direction;
+    vec3 originScaled = ray.startPoint * invDir;
+
+    stackReset();
+    int node = 0;
+    while(true){
+        int base = node * BVH_WIDTH;
+        if (BVH_STATS) nodeFetches++;
+
+        float dist[MAX_BVH_WIDTH];
+        int order[MAX_BVH_WIDTH];
+        int hits = 0;
+        for(int i=0; i<BVH_WIDTH; i++) {
+            WideChild c = wideNodes[base + i];
+            if (c.count < 0) continue;
+            if (BVH_STATS) boxTests++;
+            float d = slabEntry(c.AA, c.BB, invDir, originScaled, cullDistance(closest));
+            if (d < 0) continue;
+            // 插入排序，保持 dist 由近到远
+            int j = hits++;
+            while (j > 0 && dist[j-1] > d) {
+                dist[j] = dist[j-1];
+                order[j] = order[j-1];
+                j--;
+            }
+            dist[j] = d;
+            order[j] = i;
+        }
+
+        // 叶子由近到远直接求交，更近的叶子缩短 closest 后远处的子节点可以不再入栈
+        for(int k=0; k<hits; k++) {
+            WideChild c = wideNodes[base + order[k]];
+            if (c.count > 0 && dist[k] < cullDistance(closest)) {
+                hitArray(triangleRay, c.child, c.child + c.count - 1, anyHit, closest, closestIndex, barycentric);
+                if (anyHit && closestIndex >= 0) return ClosestHit(closest, closestIndex, -1, barycentric);
+            }
+        }
+        // 内部节点远的先入栈，近的先出栈
+        for(int k=hits-1; k>=0; k--) {
+            WideChild c = wideNodes[base + order[k]];
+            if (c.count == 0 && dist[k] < cullDistance(closest)) {
+                stackPush(c.child, dist[k]);
+            }
+        }
+        if (!stackPop(closest, node)) break;
+    }
+    // 折叠前的二叉树仍在 BVHNodes 中，叶子的三角形区间相同
+    if (stackOverflow) {
+        traverseStackless(0, triangleRay, invDir, originScaled, anyHit, closest, closestIndex, barycentric);
+    }
+    return ClosestHit(closest, closestIndex, -1, barycentric);
+}
+
+// 从 root 开始遍历二叉树，更新最近交点
+// 同时读取两个子节点测试包围盒：近的直接继续，不必再读一次；远的连同进入距离入栈
+void traverseBVH(int root, Ray ray, bool anyHit, inout float closest, inout int closestIndex, inout vec2 barycentric){
+    TriangleRay triangleRay = setupTriangleRay(ray);
+    vec3 invDir = 1.0 / ray.direction;
+    vec3 originScaled = ray.startPoint * invDir;
+
+    stackReset();
+    BVHNode node = BVHNodes[root];
+    if (BVH_STATS) { nodeFetches++; boxTests++; }
+    if (slabEntry(node.AA, node.BB, invDir, originScaled, cullDistance(closest)) < 0) return;
+    while(true){
+        if(node.n>0){
+            hitArray(triangleRay, node.index, node.index + node.n - 1, anyHit, closest, closestIndex, barycentric);
+            if (anyHit && closestIndex >= 0) return;
+        } else {
+            // 子节点下标 0 是根，不会作为子节点出现，表示该子树为空
+            BVHNode leftNode;
+            BVHNode rightNode;
+            float d1 = -1; // 左盒子距离
+            float d2 = -1; // 右盒子距离
+            if(node.left>0) {
+                leftNode = BVHNodes[node.left];
+                d1 = slabEntry(leftNode.AA, leftNode.BB, invDir, originScaled, cullDistance(closest));
+                if (BVH_STATS) { nodeFetches++; boxTests++; }
+            }
+            if(node.right>0) {
+                rightNode = BVHNodes[node.right];
+                d2 = slabEntry(rightNode.AA, rightNode.BB, invDir, originScaled, cullDistance(closest));
+                if (BVH_STATS) { nodeFetches++; boxTests++; }
+            }
+            if(d1>=0 && d2>=0) {
+                if(d1<=d2) {   // 左边先
+                    stackPush(node.right, d2);
+                    node = leftNode;
+                } else {        // 右边先
+                    stackPush(node.left, d1);
+                    node = rightNode;
+                }
+                continue;
+            }
+            if(d1>=0) {         // 仅命中左边
+                node = leftNode;
+                continue;
+            }
+            if(d2>=0) {         // 仅命中右边
+                node = rightNode;
+                continue;
+            }
+        }
+        int next;
+        if (!stackPop(closest, next)) break;
+        node = BVHNodes[next];
+        if (BVH_STATS) nodeFetches++;
+    }
+    if (stackOverflow) {
+        traverseStackless(root, triangleRay, invDir, originScaled, anyHit, closest, closestIndex, barycentric);
+    }
+}
+
+// 顶层树的叶子是实例：光线变换到物体空间后遍历该网格的底层树，
+// 方向不归一化，两个空间中的距离 t 相同，最近距离可以直接共用
+// 顶层树很浅，用单独的小栈，底层树的遍历不会覆盖它；容量按实例数确定，入栈前仍检查以防越界
+ClosestHit traceInstances(Ray ray, float tMax, bool anyHit){
+    float closest = tMax;
+    int closestIndex = -1;
+    int closestInstance = -1;
+    vec2 barycentric = vec2(0.0);
+    vec3 invDir = 1.0 / ray.direction;
+    vec3 originScaled = ray.startPoint * invDir;
+
+    int stack[TLAS_STACK_SIZE];
+    float stackDist[TLAS_STACK_SIZE];
+    int sp = 0;
+    stack[sp] = 0;
+    stackDist[sp++] = 0;
+    while(sp>0){
+        sp--;
+        if (stackDist[sp] >= cullDistance(closest)) {
+            if (BVH_STATS) culledNodes++;
+            continue;
+        }
+        BVHNode node = tlasNodes[stack[sp]];
+        if (BVH_STATS) nodeFetches++;
+        if(node.n>0){
+            for(int i=node.index; i<node.index+node.n; i++) {
+                Instance instance = instances[i];
+                Ray local;
+                local.startPoint = (instance.worldToObject * vec4(ray.startPoint, 1.0)).xyz;
+                local.direction = mat3(instance.worldToObject) * ray.direction;
+                // 同一网格的实例共用三角形下标，只能按距离是否缩短判断命中了哪个实例
+                float before = closest;
+                traverseBVH(instance.root, local, anyHit, closest, closestIndex, barycentric);
+                if (closest < before) closestInstance = i;
+                if (anyHit && closestIndex >= 0) return ClosestHit(closest, closestIndex, closestInstance, barycentric);
+            }
+            continue;
+        }
+        float d1 = node.left > 0 ? slabEntry(tlasNodes[node.left].AA, tlasNodes[node.left].BB, invDir, originScaled, cullDistance(closest)) : -1;
+        float d2 = node.right > 0 ? slabEntry(tlasNodes[node.right].AA, tlasNodes[node.right].BB, invDir, originScaled, cullDistance(closest)) : -1;
+        if (BVH_STATS) boxTests += 2u;
+        if (sp + 2 > TLAS_STACK_SIZE) break;
+        if(d1>=0 && d2>=0) {
+            stack[sp] = d1<d2 ? node.right : node.left;
+            stackDist[sp++] = max(d1, d2);
+            stack[sp] = d1<d2 ? node.left : node.right;
+            stackDist[sp++] = min(d1, d2);
+        } else if(d1>=0) {
+            stack[sp] = node.left;
+            stackDist[sp++] = d1;
+        } else if(d2>=0) {
+            stack[sp] = node.right;
+            stackDist[sp++] = d2;
+        }
+    }
+    return ClosestHit(closest, closestIndex, closestInstance, barycentric);
+}
+
+// 只找 tMax 以内的交点；anyHit 时返回遇到的第一个交点，不保证最近
+ClosestHit traceRay(Ray ray, float tMax, bool anyHit){
+    if (INSTANCING) return traceInstances(ray, tMax, anyHit);
+    if (BVH_WIDTH > 2) return traceWideBVH(ray, tMax, anyHit);
+
+    float closest = tMax;
+    int closestIndex = -1;
+    vec2 barycentric = vec2(0.0);
+    traverseBVH(0, ray, anyHit, closest, closestIndex, barycentric);
+    return ClosestHit(closest, closestIndex, -1, barycentric);
+}
+
+ClosestHit traceClosest(Ray ray){
+    return traceRay(ray, 100.0, false);
+}
+
+// 阴影光线：起点到 maxDistance 之间有任何三角形即被遮挡
+bool occluded(Ray ray, float maxDistance){
+    return traceRay(ray, maxDistance, true).index >= 0;
+}
+
+HitResult hitBVH(Ray ray){
+    return resolveHit(ray, traceClosest(ray));
+}
+
+// 每个调用只做一次原子加
+void flushTraversalStats() {
+    if (BVH_STATS) {
+        atomicAdd(statNodeFetches, nodeFetches);
+        atomicAdd(statBoxTests, boxTests);
+        atomicAdd(statTriangleTests, triangleTests);
+        atomicAdd(statStackTraffic, stackTraffic);
+        atomicAdd(statCulledNodes, culledNodes);
+    }
+}
@@ -0,0 +1,125 @@
+// 波前路径追踪各个阶段共用的声明，与 main.cpp 中的 WavefrontConstants 和 createWavefront 对应
+// 调度 -> 生成 -> (派发参数 -> 求交 -> 着色 -> 阴影光线) x maxBounce -> 累积 [-> 降噪]，阶段之间通过光线队列传递路径编号
+
+#include "scene_common.glsl"
+#include "pathtrace_common.glsl"
+
+#define WORKGROUP_SIZE 64
+#define MAX_PATHS_PER_PIXEL 16u     // 与 main.cpp 的 ADAPTIVE_MAX_PATHS 相同
+#define ADAPTIVE_MIN_LUMINANCE 0.01 // 相对误差的分母下限，很暗的像素按绝对误差收敛
+
+layout(push_constant) uniform WavefrontConstants {
+    uint frameCounter;  // 只用于随机数种子
+    int maxAccumulation;
+    uint width;
+    uint height;
+    uint bounce;        // 当前反弹次数，决定读写哪一个队列
+    uint maxBounce;
+    int rouletteDepth;
+    float rouletteProbability;
+    float adaptiveError;    // >0 时相对误差低于它的像素不再采样
+    int adaptiveMinSamples;
+    uint denoiseIteration;  // 当前 a-trous 迭代，决定读写哪一个乒乓缓冲和采样间隔
+    uint denoiseIterations;
+    uint samplePass;    // 一帧内的第几轮采样
+};
+
+// 路径按调度结果分配，每个像素的路径编号连续，总数不超过像素数
+struct PathState {
+    vec3 origin;
+    uint seed;
+    vec3 direction;
+    float bsdfPdf;          // 上一个交点做了光源采样时为其 BSDF 采样的概率密度，否则为 0，决定命中光源时的 MIS 权重
+    vec3 throughput;
+    uint pixel;
+    vec3 radiance;
+    uint pad2;
+};
+
+layout(binding = 9) buffer PathBuffer {
+    PathState paths[];
+};
+// 两个队列交替作为本次反弹的输入和下一次的输出
+layout(binding = 10) buffer QueueState {
+    uint queueCounts[2];
+    uint dispatchX;     // vkCmdDispatchIndirect 的参数
+    uint dispatchY;
+    uint dispatchZ;
+    uint activePixels;  // 本帧需要采样的像素数，帧末拷贝给 CPU 判断是否全部收敛
+};
+layout(binding = 11) buffer QueueBuffer {
+    uint queues[];      // [2][width * height]
+};
+// 每个像素已累积样本亮度的均值和方差（Welford），以及本帧分到的路径
+struct PixelSamples {
+    uint count;
+    float mean;
+    float m2;           // 与均值之差的平方和
+    uint firstPath;
+    uint pathCount;     // 调度阶段写 0 或 1，生成阶段改为实际分到的路径数
+};
+layout(binding = 15) buffer PixelSampleBuffer {
+    PixelSamples pixelSamples[];
+};
+// 主光线交点的几何信息，降噪时用来判断边缘；depth 为 0 表示没有击中
+struct GBufferTexel {
+    vec3 normal;
+    float depth;
+    vec3 albedo;
+    float pad0;
+};
+layout(binding = 16) buffer GBuffer {
+    GBufferTexel gbuffer[];
+};
+// 降噪的两个乒乓缓冲 [2][width * height]：rgb 为除去反照率的光照，a 为其亮度方差
+layout(binding = 17) buffer DenoiseBuffer {
+    vec4 denoiseTexels[];
+};
+// 降噪后的均值（a 为 1），代替 changeImage 做色调映射；changeImage 中的累积结果不受影响
+layout(binding = 18, rgba32f) uniform writeonly image2D denoisedImage;
+layout(binding = 12) buffer HitBuffer {
+    ClosestHit hits[];
+};
+// rgb 为样本之和，a 为样本数的浮点副本；准确的样本数和补偿项见 pathtrace_common.glsl
+layout(binding = 13, rgba32f) uniform image2D accumulationImage;
+// 着色阶段为每条路径最多生成一条阴影光线，由连接阶段统一求交；distance 为 0 表示没有
+struct ShadowRay {
+    vec3 origin;
+    float distance;
+    vec3 direction;
+    float pad0;
+    vec3 contribution;  // 已乘上路径的 throughput
+    float pad1;
+};
+layout(binding = 14) buffer ShadowBuffer {
+    ShadowRay shadows[];
+};
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+uint invocationIndex() {
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+uint pixelCount() {
+    return width * height;
+}
+
+uint queueSlot(uint queue, uint i) {
+    return queue * pixelCount() + i;
+}
+
+uint denoiseSlot(uint pingPong, uint i) {
+    return pingPong * pixelCount() + i;
+}
+
+// 光照 = 颜色 / 反照率，纹理细节不参与滤波，输出时再乘回
+vec3 demodulationAlbedo(GBufferTexel g) {
+    return max(g.albedo, vec3(1e-3));
+}
+
+// 像素中心对应的 [-1, 1] 屏幕坐标，与片段着色器的 pix 一致
+vec2 pixelToScreen(uint pixel) {
+    vec2 uv = (vec2(pixel % width, pixel / width) + 0.5) / vec2(width, height);
+    return vec2(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0);
+}